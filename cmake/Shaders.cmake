@@ -0,0 +1,30 @@
+# - Compile GLSL shaders to SPIR-V
+#
+#  add_shaders(<name> <shader>...) - custom target <name> that compiles the shaders with glslc
+#  and puts the <shader>.spv files next to the executables, where readSpirv() looks for them.
+#  Executables using the shaders add_dependencies() on it.
+#  GLSLC_EXECUTABLE - the glslc that is used. Taken from the vulkan sdk if possible
+
+find_program(GLSLC_EXECUTABLE glslc HINTS $ENV{VULKAN_SDK}/bin $ENV{VULKAN_SDK}/Bin)
+if(NOT GLSLC_EXECUTABLE)
+    message(WARNING "glslc not found, shaders will not be compiled")
+endif()
+
+function(add_shaders TARGET)
+    if(NOT GLSLC_EXECUTABLE)
+        add_custom_target(${TARGET})
+        return()
+    endif()
+    set(SPIRV_FILES)
+    foreach(SHADER ${ARGN})
+        get_filename_component(SHADER_NAME ${SHADER} NAME)
+        set(SPIRV ${CMAKE_RUNTIME_OUTPUT_DIRECTORY}/${SHADER_NAME}.spv)
+        add_custom_command(
+            OUTPUT ${SPIRV}
+            COMMAND ${GLSLC_EXECUTABLE} -o ${SPIRV} ${CMAKE_CURRENT_SOURCE_DIR}/${SHADER}
+            DEPENDS ${CMAKE_CURRENT_SOURCE_DIR}/${SHADER}
+            COMMENT "Compiling ${SHADER}")
+        list(APPEND SPIRV_FILES ${SPIRV})
+    endforeach()
+    add_custom_target(${TARGET} DEPENDS ${SPIRV_FILES})
+endfunction()
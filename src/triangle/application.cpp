@@ -19,8 +19,11 @@
 
 #include "SDL_vulkan.h"
 #include "util.h"
+#include <algorithm>
 #include <iostream>
+#include <limits>
 #include <optional>
+#include <stdexcept>
 
 // needed down below for validation layers
 static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
@@ -38,32 +41,67 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
 Application::Application(const ApplicationCreateInfo& appCreateInfo)
     : createInfo(appCreateInfo)
     , running(true)
-    , window(nullptr)
+    , graphicsFamily(0)
+    , presentFamily(0)
+    , frameIndex(0)
+    , frameCount(0)
+    , renderTargetFormat(vk::Format::eR8G8B8A8Unorm)
+    , resolution(appCreateInfo.targetFrameMs, appCreateInfo.minRenderScale, appCreateInfo.maxRenderScale)
+    , timestampPeriod(0.0f)
+    , timestampMask(0)
+    , lastGpuMs(0.0f)
 {
-    if (SDL_Init(createInfo.sdlInitFlags) != 0) {
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Critical SDL Error", SDL_GetError(), nullptr);
-        exit(-1);
+    if (createInfo.capture.enabled) {
+        createInfo.dynamicResolution = false;
     }
 
-    auto windowPtr = SDL_CreateWindow(
-        createInfo.title.c_str(),
-        createInfo.x,
-        createInfo.y,
-        createInfo.w,
-        createInfo.h,
-        SDL_WINDOW_VULKAN);
-    if (!windowPtr) {
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Critical SDL Window Error", SDL_GetError(), nullptr);
-        exit(-1);
+    // no video without a display, only the event loop is used. The swapchain extension is useless as well
+    if (createInfo.headless) {
+        createInfo.sdlInitFlags = SDL_INIT_EVENTS | SDL_INIT_TIMER;
+        auto& extensions = createInfo.deviceExtensions;
+        extensions.erase(
+            std::remove_if(extensions.begin(), extensions.end(), [](const char* e) {
+                return strcmp(e, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0;
+            }),
+            extensions.end());
+    }
+
+    if (SDL_Init(createInfo.sdlInitFlags) != 0) {
+        criticalError("Critical SDL Error", SDL_GetError(), nullptr);
     }
 
-    window.reset(windowPtr);
+    auto mainWindowData = std::make_unique<WindowData>();
+    mainWindowData->w = createInfo.w;
+    mainWindowData->h = createInfo.h;
+    if (!createInfo.headless) {
+        auto windowPtr = SDL_CreateWindow(
+            createInfo.title.c_str(),
+            createInfo.x,
+            createInfo.y,
+            createInfo.w,
+            createInfo.h,
+            SDL_WINDOW_VULKAN | createInfo.windowFlags);
+        if (!windowPtr) {
+            criticalError("Critical SDL Window Error", SDL_GetError(), nullptr);
+        }
+
+        mainWindowData->window.reset(windowPtr);
+        mainWindowData->id = SDL_GetWindowID(windowPtr);
+    }
+    windows.push_back(std::move(mainWindowData));
 
     initVulkan();
 }
 
 Application::~Application()
 {
+    // swapchains go before their surfaces, surfaces before their windows and those before SDL
+    if (logicalDevice) {
+        logicalDevice->waitIdle();
+    }
+    retireQueue.clear();
+    windows.clear();
+    SDL_Quit();
 }
 
 void Application::run()
@@ -73,26 +111,162 @@ void Application::run()
         while (SDL_PollEvent(&e)) {
             handleEvent(e);
         }
+
+        uint64_t framesBefore = frameCount;
+        drawFrame();
+        // nothing to draw to (all windows minimized), sleep until something happens instead of spinning
+        if (frameCount == framesBefore) {
+            SDL_WaitEventTimeout(nullptr, 100);
+        }
+        if (createInfo.maxFrames > 0 && frameCount >= createInfo.maxFrames) {
+            running = false;
+        }
     }
 
+    // shutdown, the only place where we wait for everything
     logicalDevice->waitIdle();
+    retireQueue.collect();
+    if (frameCapture) {
+        frameCapture->poll();
+        if (createInfo.enableValidation) {
+            std::cerr << "Captured " << frameCapture->capturedFrames() << " frames, dropped " << frameCapture->droppedFrames() << std::endl;
+            if (frameCapture->writeFailed()) {
+                std::cerr << "Capture output failed, frames after that were dropped" << std::endl;
+            }
+        }
+    }
+    // tells how large frameMemorySize should be
+    if (createInfo.enableValidation) {
+        std::cerr << "Frame memory high water mark " << frameAllocator->highWaterMark() << " of " << frameAllocator->capacity() << " bytes, " << frameAllocator->spillCount() << " spills" << std::endl;
+    }
+}
+
+ComputeQueue& Application::compute()
+{
+    return *computeQueue;
+}
+
+GpuTimeline& Application::graphicsTimeline()
+{
+    return graphicsQueueTimeline;
+}
+
+void Application::waitBeforeFrame(const TimelineWait& w)
+{
+    frameWaits.push_back(w);
+}
+
+float Application::gpuFrameMs() const
+{
+    return lastGpuMs;
+}
+
+float Application::renderScale() const
+{
+    return resolution.scale();
+}
+
+FrameCapture* Application::capture()
+{
+    return frameCapture.get();
+}
+
+FrameAllocator& Application::frameMemory()
+{
+    return *frameAllocator;
+}
+
+Uint32 Application::openWindow(const std::string& title, int x, int y, int w, int h)
+{
+    if (createInfo.headless) {
+        throw std::runtime_error("Cannot open windows in a headless application");
+    }
+
+    auto windowPtr = SDL_CreateWindow(title.c_str(), x, y, w, h, SDL_WINDOW_VULKAN | createInfo.windowFlags);
+    if (!windowPtr) {
+        throw std::runtime_error(std::string("Cannot open window: ") + SDL_GetError());
+    }
+
+    auto data = std::make_unique<WindowData>();
+    data->window.reset(windowPtr);
+    data->id = SDL_GetWindowID(windowPtr);
+    data->w = w;
+    data->h = h;
+    initVulkanSurface(*data);
+    // all windows present in one call on one queue
+    if (!physicalDevice.getSurfaceSupportKHR(presentFamily, data->surface.get())) {
+        throw std::runtime_error("The present queue cannot present to the new window");
+    }
+    initWindow(*data);
+
+    windows.push_back(std::move(data));
+    return windows.back()->id;
+}
+
+void Application::closeWindow(Uint32 id)
+{
+    // the main window ends the application instead
+    for (size_t i = 1; i < windows.size(); i++) {
+        if (windows[i]->id == id) {
+            retire(std::move(windows[i]));
+            windows.erase(windows.begin() + i);
+            return;
+        }
+    }
+}
+
+WindowData* Application::findWindow(Uint32 id)
+{
+    for (auto& window : windows) {
+        if (window->window && window->id == id) {
+            return window.get();
+        }
+    }
+    return nullptr;
+}
+
+SDL_Window* Application::mainWindow() const
+{
+    return windows.empty() ? nullptr : windows[0]->window.get();
+}
+
+void Application::criticalError(const char* title, const char* message, SDL_Window* window) const
+{
+    // nobody would see a message box without a display
+    if (createInfo.headless) {
+        std::cerr << title << ": " << message << std::endl;
+    } else {
+        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, title, message, window);
+    }
+    exit(-1);
 }
 
 void Application::handleEvent(const SDL_Event& e)
 {
     switch (e.type) {
-    case SDL_WINDOWEVENT:
-        switch (e.window.type) {
+    case SDL_WINDOWEVENT: {
+        auto window = findWindow(e.window.windowID);
+        if (!window) {
+            break;
+        }
+        switch (e.window.event) {
         case SDL_WINDOWEVENT_CLOSE:
-            running = false;
+            if (window == windows[0].get()) {
+                running = false;
+            } else {
+                closeWindow(window->id);
+            }
             break;
         case SDL_WINDOWEVENT_RESIZED:
-            // TODO: Handle resize?
+            window->w = e.window.data1;
+            window->h = e.window.data2;
+            window->dirty = true;
             break;
         default:
             break;
         }
         break;
+    }
     case SDL_QUIT:
         running = false;
         break;
@@ -105,21 +279,31 @@ void Application::initVulkan()
 {
     try {
         initVulkanInstance();
-        initVulkanSurface();
+        // without the main window there is nothing to run, later windows just fail to open
+        if (windows[0]->window) {
+            try {
+                initVulkanSurface(*windows[0]);
+            } catch (std::runtime_error& err) {
+                criticalError("SDL Vulkan Window Surface Error", err.what(), mainWindow());
+            }
+        }
         initVulkanPhysicalDevice();
         initVulkanLogicalDevice();
-        rebuildSwapchain();
+        initFrames();
+        initWindow(*windows[0]);
     } catch (vk::SystemError err) {
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Ciritical Vulkan Error", err.what(), window.get());
-        exit(-1);
+        criticalError("Ciritical Vulkan Error", err.what(), mainWindow());
     }
 }
 
 void Application::initVulkanInstance()
 {
-    // get sdl2 needed extensions
+    // get sdl2 needed extensions. headless does not need any
+    auto window = mainWindow();
     uint32_t sdlExtensionCount = 0;
-    SDL_Vulkan_GetInstanceExtensions(window.get(), &sdlExtensionCount, nullptr);
+    if (window) {
+        SDL_Vulkan_GetInstanceExtensions(window, &sdlExtensionCount, nullptr);
+    }
 
     // if we want validation, we need the extension for the callback
     if (createInfo.enableValidation) {
@@ -127,7 +311,9 @@ void Application::initVulkanInstance()
     }
     std::vector<const char*> extensions;
     extensions.resize(sdlExtensionCount);
-    SDL_Vulkan_GetInstanceExtensions(window.get(), &sdlExtensionCount, extensions.data());
+    if (window) {
+        SDL_Vulkan_GetInstanceExtensions(window, &sdlExtensionCount, extensions.data());
+    }
     // add requested extensions
     extensions.insert(extensions.end(), createInfo.instanceExtensions.begin(), createInfo.instanceExtensions.end());
 
@@ -152,7 +338,7 @@ void Application::initVulkanInstance()
         VK_MAKE_VERSION(0, 0, 1),
         "No Engine",
         VK_MAKE_VERSION(1, 0, 0),
-        VK_API_VERSION_1_1);
+        VK_API_VERSION_1_2);
 
     vk::InstanceCreateInfo instanceInfo(
         vk::InstanceCreateFlags(),
@@ -180,26 +366,28 @@ void Application::initVulkanInstance()
     }
 }
 
-void Application::initVulkanSurface()
+void Application::initVulkanSurface(WindowData& window)
 {
     VkSurfaceKHR surface;
-    if (!SDL_Vulkan_CreateSurface(window.get(), instance.get(), &surface)) {
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "SDL Vulkan Window Surface Error", SDL_GetError(), window.get());
-        exit(-1);
+    if (!SDL_Vulkan_CreateSurface(window.window.get(), instance.get(), &surface)) {
+        throw std::runtime_error(std::string("Cannot create window surface: ") + SDL_GetError());
     }
 
     // otherwise this gets created with the default delete wich has things set to gibberish
     vk::ObjectDestroy<vk::Instance, vk::DispatchLoaderStatic> surfaceDeleter(instance.get());
-    windowSurface = vk::UniqueSurfaceKHR(surface, surfaceDeleter);
+    window.surface = vk::UniqueSurfaceKHR(surface, surfaceDeleter);
 }
 
 void Application::initVulkanPhysicalDevice()
 {
+    // the main window decides, others have to make do
+    const auto& windowSurface = windows[0]->surface;
+    auto window = mainWindow();
+
     // lets see what we have
     auto availableDevices = instance->enumeratePhysicalDevices();
     if (availableDevices.empty()) {
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Critical Vulkan Error", "No GPU Available", window.get());
-        exit(-1);
+        criticalError("Critical Vulkan Error", "No GPU Available", window);
     }
     // pick the phyiscal device.
     // we must support all extensions,
@@ -228,6 +416,21 @@ void Application::initVulkanPhysicalDevice()
             continue;
         }
 
+        // we need timeline semaphores, so vulkan 1.2
+        if (device.getProperties().apiVersion < VK_API_VERSION_1_2) {
+            continue;
+        }
+        auto features = device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+        if (!features.get<vk::PhysicalDeviceVulkan12Features>().timelineSemaphore) {
+            continue;
+        }
+
+        // headless is done here
+        if (!windowSurface) {
+            physicalDevice = device;
+            continue;
+        }
+
         // check up on the swap chain
         auto formats = device.getSurfaceFormatsKHR(windowSurface.get());
         auto modes = device.getSurfacePresentModesKHR(windowSurface.get());
@@ -239,8 +442,7 @@ void Application::initVulkanPhysicalDevice()
     }
 
     if (!physicalDevice) {
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Critical Vulkan Error", "No Suitable GPU Availabe", window.get());
-        exit(-1);
+        criticalError("Critical Vulkan Error", "No Suitable GPU Availabe", window);
     }
 
     if (createInfo.enableValidation) {
@@ -250,9 +452,11 @@ void Application::initVulkanPhysicalDevice()
 
 void Application::initVulkanLogicalDevice()
 {
-    QueueFamilyData familyData(physicalDevice, windowSurface);
+    QueueFamilyData familyData(physicalDevice, windows[0]->surface);
     auto queueInfos = familyData.getCreateInfos();
     vk::PhysicalDeviceFeatures features;
+    vk::PhysicalDeviceVulkan12Features features12;
+    features12.timelineSemaphore = true;
     vk::DeviceCreateInfo deviceInfo(
         vk::DeviceCreateFlags(),
         static_cast<uint32_t>(queueInfos.size()),
@@ -262,35 +466,47 @@ void Application::initVulkanLogicalDevice()
         static_cast<uint32_t>(createInfo.deviceExtensions.size()),
         createInfo.deviceExtensions.data(),
         &features);
+    deviceInfo.pNext = &features12;
 
     logicalDevice = physicalDevice.createDeviceUnique(deviceInfo);
     dldevice.init(instance.get(), logicalDevice.get());
-    logicalDevice->getQueue(familyData.graphicsFamily.value(), 0, &graphicsQueue, dldevice);
-    logicalDevice->getQueue(familyData.presentFamily.value(), 0, &presentQueue, dldevice);
+    graphicsFamily = familyData.graphicsFamily.value();
+    logicalDevice->getQueue(graphicsFamily, 0, &graphicsQueue, dldevice);
+    if (familyData.presentFamily) {
+        presentFamily = familyData.presentFamily.value();
+        logicalDevice->getQueue(presentFamily, 0, &presentQueue, dldevice);
+    }
+
+    // async compute shares its buffers with graphics
+    vk::Queue queue;
+    logicalDevice->getQueue(familyData.computeFamily.value(), 0, &queue, dldevice);
+    std::vector<uint32_t> sharingFamilies = { familyData.graphicsFamily.value() };
+    if (familyData.computeFamily != familyData.graphicsFamily) {
+        sharingFamilies.push_back(familyData.computeFamily.value());
+    }
+    computeQueue = std::make_unique<ComputeQueue>(logicalDevice.get(), familyData.computeFamily.value(), queue, sharingFamilies);
 }
 
-void Application::rebuildSwapchain()
+void Application::rebuildSwapchain(WindowData& window)
 {
-    // cleanup old swapchain
-    logicalDevice->waitIdle();
+    window.dirty = false;
 
     // make new swapchain
     // find properties
-    auto formats = physicalDevice.getSurfaceFormatsKHR(windowSurface.get());
-    auto modes = physicalDevice.getSurfacePresentModesKHR(windowSurface.get());
+    auto formats = physicalDevice.getSurfaceFormatsKHR(window.surface.get());
+    auto modes = physicalDevice.getSurfacePresentModesKHR(window.surface.get());
     if (modes.empty() || formats.empty()) {
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Critical Vulkan Error", "No mode or format for swapchain", window.get());
-        exit(-1);
+        criticalError("Critical Vulkan Error", "No mode or format for swapchain", window.window.get());
     }
 
     // calculate extend
-    auto capabilities = physicalDevice.getSurfaceCapabilitiesKHR(windowSurface.get());
+    auto capabilities = physicalDevice.getSurfaceCapabilitiesKHR(window.surface.get());
     auto extend = capabilities.currentExtent;
     // if this is true, we need to yell a bit
     if (extend.width == std::numeric_limits<uint32_t>::max()) {
         extend = {
-            static_cast<uint32_t>(createInfo.w),
-            static_cast<uint32_t>(createInfo.h)
+            static_cast<uint32_t>(window.w),
+            static_cast<uint32_t>(window.h)
         };
 
         extend.width = std::max(
@@ -301,6 +517,12 @@ void Application::rebuildSwapchain()
             std::min(capabilities.maxImageExtent.height, extend.height));
     }
 
+    // minimized, try again once there is something to draw to
+    if (extend.width == 0 || extend.height == 0) {
+        window.dirty = true;
+        return;
+    }
+
     // determin mode. try to use the default one
     auto mode = modes[0];
     for (const auto& availableMode : modes) {
@@ -310,38 +532,58 @@ void Application::rebuildSwapchain()
         }
     }
 
-    // determin format.
-    vk::SurfaceFormatKHR format = formats[0];
+    // determin format. frames are blitted into the swapchain, so take the first one that can be blitted to
     if (formats.size() == 1 && formats[0].format == vk::Format::eUndefined) {
-        format = { vk::Format::eB8G8R8Unorm, vk::ColorSpaceKHR::eSrgbNonlinear };
+        formats = { { vk::Format::eB8G8R8A8Unorm, vk::ColorSpaceKHR::eSrgbNonlinear }, { vk::Format::eR8G8B8A8Unorm, vk::ColorSpaceKHR::eSrgbNonlinear } };
+    }
+    auto formatIter = std::find_if(formats.begin(), formats.end(), [this](const vk::SurfaceFormatKHR& f) {
+        return static_cast<bool>(physicalDevice.getFormatProperties(f.format).optimalTilingFeatures & vk::FormatFeatureFlagBits::eBlitDst);
+    });
+    if (formatIter == formats.end() || !(capabilities.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferDst)) {
+        criticalError("Critical Vulkan Error", "Swapchain images cannot be blitted to", window.window.get());
     }
+    vk::SurfaceFormatKHR format = *formatIter;
 
-    // need this for the queue indexes
-    auto queueIndexes = QueueFamilyData(physicalDevice, windowSurface).getUnique();
+    // need this for the queue indexes. compute does not touch the swapchain
+    std::vector<uint32_t> queueIndexes = { graphicsFamily };
+    if (presentFamily != graphicsFamily) {
+        queueIndexes.push_back(presentFamily);
+    }
 
     // swap chain image count
     auto imageCount = std::min(capabilities.maxImageCount, capabilities.minImageCount + 1);
     vk::SwapchainCreateInfoKHR swapCreateInfo(
         vk::SwapchainCreateFlagsKHR(),
-        windowSurface.get(),
+        window.surface.get(),
         imageCount,
         format.format,
         format.colorSpace,
         extend,
         1,
-        vk::ImageUsageFlagBits::eColorAttachment,
+        vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferDst,
         queueIndexes.size() > 1 ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive,
         static_cast<uint32_t>(queueIndexes.size()),
         queueIndexes.data(),
         capabilities.currentTransform,
         vk::CompositeAlphaFlagBitsKHR::eOpaque,
         mode,
-        true);
-
-    swapchain = logicalDevice->createSwapchainKHRUnique(swapCreateInfo);
-    swapchainImages = logicalDevice->getSwapchainImagesKHR(swapchain.get());
-    swapchainViews.reserve(swapchainImages.size());
-    for (auto image : swapchainImages) {
+        true,
+        window.swapchain.get());
+
+    // no waiting here, the old swapchain lives on until the frames using it are done
+    auto newSwapchain = logicalDevice->createSwapchainKHRUnique(swapCreateInfo);
+    retire(std::move(window.swapchain));
+    retire(std::move(window.views));
+    retire(std::move(window.renderFinished));
+    window.views.clear();
+    window.renderFinished.clear();
+
+    window.swapchain = std::move(newSwapchain);
+    window.format = format.format;
+    window.extent = extend;
+    window.images = logicalDevice->getSwapchainImagesKHR(window.swapchain.get());
+    window.views.reserve(window.images.size());
+    for (auto image : window.images) {
         vk::ComponentMapping mapping(
             vk::ComponentSwizzle::eR,
             vk::ComponentSwizzle::eG,
@@ -355,6 +597,421 @@ void Application::rebuildSwapchain()
             format.format,
             mapping,
             range);
-        swapchainViews.push_back(logicalDevice->createImageViewUnique(viewCreateInfo));
+        window.views.push_back(logicalDevice->createImageViewUnique(viewCreateInfo));
+        window.renderFinished.push_back(logicalDevice->createSemaphoreUnique(vk::SemaphoreCreateInfo()));
+    }
+
+    rebuildRenderTarget(window);
+}
+
+void Application::rebuildRenderTarget(WindowData& window)
+{
+    vk::Extent2D extent = window.extent;
+    if (!window.swapchain) {
+        extent = vk::Extent2D(static_cast<uint32_t>(window.w), static_cast<uint32_t>(window.h));
+    }
+
+    // allocated at full size once, scaling just renders to less of it
+    retire(std::move(window.framebuffer));
+    retire(std::move(window.renderTarget));
+    window.renderTarget = createImage(
+        physicalDevice,
+        logicalDevice.get(),
+        extent,
+        renderTargetFormat,
+        vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eSampled);
+
+    auto view = window.renderTarget.view.get();
+    vk::FramebufferCreateInfo framebufferInfo(
+        vk::FramebufferCreateFlags(),
+        renderPass.get(),
+        1,
+        &view,
+        extent.width,
+        extent.height,
+        1);
+    window.framebuffer = logicalDevice->createFramebufferUnique(framebufferInfo);
+    window.renderExtent = createInfo.dynamicResolution ? resolution.apply(extent) : extent;
+}
+
+void Application::initFrames()
+{
+    graphicsQueueTimeline = GpuTimeline(logicalDevice.get());
+
+    vk::CommandPoolCreateInfo poolInfo(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, graphicsFamily);
+    commandPool = logicalDevice->createCommandPoolUnique(poolInfo);
+
+    vk::CommandBufferAllocateInfo allocInfo(commandPool.get(), vk::CommandBufferLevel::ePrimary, createInfo.framesInFlight);
+    auto commandBuffers = logicalDevice->allocateCommandBuffersUnique(allocInfo);
+    frames.resize(createInfo.framesInFlight);
+    for (uint32_t i = 0; i < createInfo.framesInFlight; i++) {
+        frames[i].commandBuffer = std::move(commandBuffers[i]);
+        frames[i].timelineValue = 0;
+    }
+
+    // gpu frame times for dynamic resolution
+    auto properties = physicalDevice.getProperties();
+    auto families = physicalDevice.getQueueFamilyProperties();
+    if (properties.limits.timestampComputeAndGraphics && families[graphicsFamily].timestampValidBits > 0) {
+        vk::QueryPoolCreateInfo queryInfo(vk::QueryPoolCreateFlags(), vk::QueryType::eTimestamp, 2 * createInfo.framesInFlight);
+        timestampPool = logicalDevice->createQueryPoolUnique(queryInfo);
+        timestampPeriod = properties.limits.timestampPeriod;
+        uint32_t validBits = families[graphicsFamily].timestampValidBits;
+        timestampMask = validBits >= 64 ? std::numeric_limits<uint64_t>::max() : (uint64_t(1) << validBits) - 1;
+    }
+
+    // offscreen targets are scaled up with a linear blit
+    auto targetFeatures = physicalDevice.getFormatProperties(renderTargetFormat).optimalTilingFeatures;
+    auto neededFeatures = vk::FormatFeatureFlagBits::eColorAttachment | vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+    if ((targetFeatures & neededFeatures) != neededFeatures) {
+        criticalError("Critical Vulkan Error", "Render target format cannot be blitted from", mainWindow());
+    }
+
+    // one render pass for all offscreen targets, so pipelines stay valid across resizes and windows
+    vk::AttachmentDescription colorAttachment(
+        vk::AttachmentDescriptionFlags(),
+        renderTargetFormat,
+        vk::SampleCountFlagBits::e1,
+        vk::AttachmentLoadOp::eClear,
+        vk::AttachmentStoreOp::eStore,
+        vk::AttachmentLoadOp::eDontCare,
+        vk::AttachmentStoreOp::eDontCare,
+        vk::ImageLayout::eUndefined,
+        vk::ImageLayout::eTransferSrcOptimal);
+    vk::AttachmentReference colorReference(0, vk::ImageLayout::eColorAttachmentOptimal);
+    vk::SubpassDescription subpass(
+        vk::SubpassDescriptionFlags(),
+        vk::PipelineBindPoint::eGraphics,
+        0,
+        nullptr,
+        1,
+        &colorReference);
+    // the previous frame reads the target in a blit, the next one reads it after the pass
+    std::array<vk::SubpassDependency, 2> dependencies = {
+        vk::SubpassDependency(
+            VK_SUBPASS_EXTERNAL,
+            0,
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::PipelineStageFlagBits::eColorAttachmentOutput,
+            vk::AccessFlagBits::eTransferRead,
+            vk::AccessFlagBits::eColorAttachmentWrite),
+        vk::SubpassDependency(
+            0,
+            VK_SUBPASS_EXTERNAL,
+            vk::PipelineStageFlagBits::eColorAttachmentOutput,
+            vk::PipelineStageFlagBits::eTransfer,
+            vk::AccessFlagBits::eColorAttachmentWrite,
+            vk::AccessFlagBits::eTransferRead)
+    };
+    vk::RenderPassCreateInfo renderPassInfo(
+        vk::RenderPassCreateFlags(),
+        1,
+        &colorAttachment,
+        1,
+        &subpass,
+        static_cast<uint32_t>(dependencies.size()),
+        dependencies.data());
+    renderPass = logicalDevice->createRenderPassUnique(renderPassInfo);
+
+    if (createInfo.capture.enabled) {
+        frameCapture = std::make_unique<FrameCapture>(physicalDevice, logicalDevice.get(), createInfo.capture);
+    }
+
+    // graphics only, a reset just waits for the graphics timeline. Async compute would need its own wait
+    frameAllocator = std::make_unique<FrameAllocator>(
+        physicalDevice,
+        logicalDevice.get(),
+        createInfo.framesInFlight,
+        createInfo.frameMemorySize);
+}
+
+void Application::initWindow(WindowData& window)
+{
+    window.imageAvailable.clear();
+    for (uint32_t i = 0; i < createInfo.framesInFlight; i++) {
+        window.imageAvailable.push_back(logicalDevice->createSemaphoreUnique(vk::SemaphoreCreateInfo()));
+    }
+
+    if (window.surface) {
+        rebuildSwapchain(window);
+    } else {
+        rebuildRenderTarget(window);
     }
 }
+
+bool Application::acquire(WindowData& window)
+{
+    window.acquired = false;
+    if (!window.surface) {
+        return true;
+    }
+
+    if (window.dirty) {
+        rebuildSwapchain(window);
+    }
+    // nothing to draw to, i.e. minimized
+    if (window.dirty || !window.swapchain) {
+        return false;
+    }
+
+    auto result = logicalDevice->acquireNextImageKHR(
+        window.swapchain.get(),
+        std::numeric_limits<uint64_t>::max(),
+        window.imageAvailable[frameIndex].get(),
+        vk::Fence(),
+        &window.imageIndex);
+    if (result == vk::Result::eErrorOutOfDateKHR) {
+        window.dirty = true;
+        return false;
+    }
+    if (result != vk::Result::eSuccess && result != vk::Result::eSuboptimalKHR) {
+        throw std::runtime_error("Cannot acquire swapchain image: " + vk::to_string(result));
+    }
+
+    window.acquired = true;
+    return true;
+}
+
+void Application::drawFrame()
+{
+    auto& frame = frames[frameIndex];
+
+    // the only wait in the loop: for the frame that used this slot before
+    graphicsQueueTimeline.wait(frame.timelineValue);
+    retireQueue.collect();
+    frameAllocator->reset(frameIndex);
+    updateRenderScale();
+    if (frameCapture) {
+        frameCapture->poll();
+    }
+
+    std::vector<WindowData*> targets;
+    for (auto& window : windows) {
+        if (acquire(*window)) {
+            targets.push_back(window.get());
+        }
+    }
+    if (targets.empty()) {
+        return;
+    }
+
+    auto commandBuffer = frame.commandBuffer.get();
+    commandBuffer.reset(vk::CommandBufferResetFlags());
+    commandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+    recordFrame(commandBuffer, targets);
+    commandBuffer.end();
+
+    // one submit for all windows
+    TimelineSubmit submitData;
+    for (const auto& w : frameWaits) {
+        submitData.wait(w);
+    }
+    frameWaits.clear();
+    for (auto window : targets) {
+        if (window->acquired) {
+            submitData.wait(window->imageAvailable[frameIndex].get(), vk::PipelineStageFlagBits::eTransfer);
+            submitData.signal(window->renderFinished[window->imageIndex].get());
+        }
+    }
+    frame.timelineValue = graphicsQueueTimeline.next();
+    submitData.signal({ graphicsQueueTimeline.semaphore(), frame.timelineValue });
+
+    std::vector<vk::CommandBuffer> commandBuffers = { commandBuffer };
+    graphicsQueue.submit(submitData.get(commandBuffers), vk::Fence());
+    frameIndex = (frameIndex + 1) % static_cast<uint32_t>(frames.size());
+    frameCount++;
+
+    // and one present for all of them
+    std::vector<WindowData*> presented;
+    std::vector<vk::Semaphore> waitSemaphores;
+    std::vector<vk::SwapchainKHR> swapchains;
+    std::vector<uint32_t> imageIndices;
+    for (auto window : targets) {
+        if (window->acquired) {
+            presented.push_back(window);
+            waitSemaphores.push_back(window->renderFinished[window->imageIndex].get());
+            swapchains.push_back(window->swapchain.get());
+            imageIndices.push_back(window->imageIndex);
+            window->acquired = false;
+        }
+    }
+    if (presented.empty()) {
+        return;
+    }
+
+    std::vector<vk::Result> results(presented.size(), vk::Result::eSuccess);
+    vk::PresentInfoKHR presentInfo(
+        static_cast<uint32_t>(waitSemaphores.size()),
+        waitSemaphores.data(),
+        static_cast<uint32_t>(swapchains.size()),
+        swapchains.data(),
+        imageIndices.data(),
+        results.data());
+    // the per swapchain results tell which windows need a rebuild
+    if (presentQueue.presentKHR(&presentInfo) == vk::Result::eErrorDeviceLost) {
+        throw std::runtime_error("Device lost while presenting");
+    }
+    for (size_t i = 0; i < presented.size(); i++) {
+        if (results[i] == vk::Result::eErrorOutOfDateKHR || results[i] == vk::Result::eSuboptimalKHR) {
+            presented[i]->dirty = true;
+        } else if (results[i] != vk::Result::eSuccess) {
+            throw std::runtime_error("Cannot present: " + vk::to_string(results[i]));
+        }
+    }
+}
+
+void Application::recordFrame(vk::CommandBuffer commandBuffer, const std::vector<WindowData*>& targets)
+{
+    auto& frame = frames[frameIndex];
+    if (timestampPool) {
+        // start where the earliest wait for other queues ends, time spent waiting for compute is not ours
+        VkPipelineStageFlags waitStages = 0;
+        for (const auto& w : frameWaits) {
+            waitStages |= static_cast<VkPipelineStageFlags>(w.stage);
+        }
+        auto startStage = vk::PipelineStageFlagBits::eTopOfPipe;
+        if (waitStages != 0) {
+            startStage = static_cast<vk::PipelineStageFlagBits>(waitStages & (~waitStages + 1));
+        }
+        commandBuffer.resetQueryPool(timestampPool.get(), 2 * frameIndex, 2);
+        commandBuffer.writeTimestamp(startStage, timestampPool.get(), 2 * frameIndex);
+    }
+
+    for (auto window : targets) {
+        vk::ClearValue clearValue(createInfo.clearColor);
+        vk::Rect2D renderArea(vk::Offset2D(0, 0), window->renderExtent);
+        vk::RenderPassBeginInfo beginInfo(
+            renderPass.get(),
+            window->framebuffer.get(),
+            renderArea,
+            1,
+            &clearValue);
+        commandBuffer.beginRenderPass(beginInfo, vk::SubpassContents::eInline);
+        vk::Viewport viewport(
+            0.0f,
+            0.0f,
+            static_cast<float>(window->renderExtent.width),
+            static_cast<float>(window->renderExtent.height),
+            0.0f,
+            1.0f);
+        commandBuffer.setViewport(0, viewport);
+        commandBuffer.setScissor(0, renderArea);
+        recordScene(commandBuffer, *window);
+        commandBuffer.endRenderPass();
+    }
+
+    // only the scene is timed. The blits wait for the swapchain images, with vsync that is most of the frame
+    if (timestampPool) {
+        commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, timestampPool.get(), 2 * frameIndex + 1);
+        frame.timed = true;
+    }
+
+    for (auto window : targets) {
+        // the target is in eTransferSrcOptimal now. the copy signals with this frame
+        if (frameCapture && window == windows[0].get()) {
+            frameCapture->record(
+                commandBuffer,
+                window->renderTarget.image.get(),
+                window->renderTarget.format,
+                window->renderExtent,
+                graphicsQueueTimeline,
+                graphicsQueueTimeline.pending());
+        }
+
+        if (window->acquired) {
+            blitToSwapchain(commandBuffer, *window);
+        }
+    }
+}
+
+void Application::recordScene(vk::CommandBuffer commandBuffer, const WindowData& window)
+{
+    // nothing to draw here, the render pass clears
+}
+
+void Application::blitToSwapchain(vk::CommandBuffer commandBuffer, WindowData& window)
+{
+    auto image = window.images[window.imageIndex];
+    vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+    vk::ImageMemoryBarrier toBlit(
+        vk::AccessFlags(),
+        vk::AccessFlagBits::eTransferWrite,
+        vk::ImageLayout::eUndefined,
+        vk::ImageLayout::eTransferDstOptimal,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        image,
+        range);
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::DependencyFlags(),
+        nullptr,
+        nullptr,
+        toBlit);
+
+    // upscale with a linear filter. at a scale of 1 this is a plain copy
+    vk::ImageSubresourceLayers layers(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
+    vk::ImageBlit region(
+        layers,
+        { vk::Offset3D(0, 0, 0), vk::Offset3D(static_cast<int32_t>(window.renderExtent.width), static_cast<int32_t>(window.renderExtent.height), 1) },
+        layers,
+        { vk::Offset3D(0, 0, 0), vk::Offset3D(static_cast<int32_t>(window.extent.width), static_cast<int32_t>(window.extent.height), 1) });
+    commandBuffer.blitImage(
+        window.renderTarget.image.get(),
+        vk::ImageLayout::eTransferSrcOptimal,
+        image,
+        vk::ImageLayout::eTransferDstOptimal,
+        region,
+        vk::Filter::eLinear);
+
+    vk::ImageMemoryBarrier toPresent(
+        vk::AccessFlagBits::eTransferWrite,
+        vk::AccessFlags(),
+        vk::ImageLayout::eTransferDstOptimal,
+        vk::ImageLayout::ePresentSrcKHR,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        image,
+        range);
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eBottomOfPipe,
+        vk::DependencyFlags(),
+        nullptr,
+        nullptr,
+        toPresent);
+}
+
+void Application::updateRenderScale()
+{
+    auto& frame = frames[frameIndex];
+    if (!timestampPool || !frame.timed) {
+        return;
+    }
+    frame.timed = false;
+
+    // the slot is done, so this never waits
+    uint64_t timestamps[2] = { 0, 0 };
+    auto result = logicalDevice->getQueryPoolResults(
+        timestampPool.get(),
+        2 * frameIndex,
+        2,
+        sizeof(timestamps),
+        timestamps,
+        sizeof(uint64_t),
+        vk::QueryResultFlagBits::e64);
+    if (result != vk::Result::eSuccess) {
+        return;
+    }
+
+    // only the valid bits count, the counter wraps around there
+    uint64_t ticks = (timestamps[1] - timestamps[0]) & timestampMask;
+    lastGpuMs = static_cast<float>(ticks) * timestampPeriod / 1000000.0f;
+    if (createInfo.dynamicResolution) {
+        resolution.update(lastGpuMs);
+        for (auto& window : windows) {
+            window->renderExtent = resolution.apply(window->renderTarget.extent);
+        }
+    }
+}
\ No newline at end of file
@@ -18,17 +18,25 @@
 #ifndef _application_h
 #define _application_h
 
+#include "capture.h"
+#include "compute.h"
+#include "framealloc.h"
+#include "resolution.h"
+#include "util.h"
+
 #include <SDL.h>
+#include <array>
+#include <memory>
 #include <string>
 #include <vector>
 #include <vulkan/vulkan.hpp>
 
+// SDL_Quit is up to the Application, there can be more than one window
 struct SdlDeleter {
     void operator()(SDL_Window* w)
     {
         if (w) {
             SDL_DestroyWindow(w);
-            SDL_Quit();
         }
     }
 };
@@ -39,12 +47,70 @@ struct ApplicationCreateInfo {
     int y = SDL_WINDOWPOS_CENTERED;
     int w = 800;
     int h = 600;
+    /// ignored if headless, that only inits events and timers
     Uint32 sdlInitFlags = SDL_INIT_EVERYTHING;
+    /// flags of all windows, SDL_WINDOW_VULKAN is always added
+    Uint32 windowFlags = 0;
     bool enableValidation = true;
     std::vector<const char*> instanceExtensions;
     std::vector<const char*> instanceLayers;
     std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
     vk::PresentModeKHR defaultPresetMode = vk::PresentModeKHR::eFifo;
+    /// no window, surface or swapchain. Works without a display
+    bool headless = false;
+    /// frames the cpu may record ahead of the gpu
+    uint32_t framesInFlight = 2;
+    vk::ClearColorValue clearColor = vk::ClearColorValue(std::array<float, 4>({ 0.0f, 0.0f, 0.0f, 1.0f }));
+    /// render at a fraction of the window size, picked from the measured gpu frame time
+    bool dynamicResolution = false;
+    float targetFrameMs = 16.0f;
+    float minRenderScale = 0.5f;
+    float maxRenderScale = 1.0f;
+    /// read back rendered frames of the main window. Turns off dynamic resolution, captures need a fixed size
+    CaptureInfo capture;
+    /// stop after this many frames, 0 runs until quit. Mostly for headless runs
+    uint64_t maxFrames = 0;
+    /// bytes of transient per draw data per frame in flight. Grows if a frame needs more
+    vk::DeviceSize frameMemorySize = 4 * 1024 * 1024;
+};
+
+/// everything one frame in flight needs. Reusable once the graphics timeline reached timelineValue
+struct FrameData {
+    vk::UniqueCommandBuffer commandBuffer;
+    uint64_t timelineValue = 0;
+    /// true if the timestamps of this slot were written by the last submit
+    bool timed = false;
+};
+
+/**
+ * \brief A window with its surface, swapchain and offscreen target
+ * Headless applications have a single one of these without SDL window, surface and swapchain.
+ * Members are destroyed bottom up, so the swapchain goes before the surface and that before the window.
+ */
+struct WindowData {
+    std::unique_ptr<SDL_Window, SdlDeleter> window;
+    Uint32 id = 0;
+    int w = 0;
+    int h = 0;
+    vk::UniqueSurfaceKHR surface;
+    vk::UniqueSwapchainKHR swapchain;
+    vk::Format format = vk::Format::eUndefined;
+    vk::Extent2D extent;
+    std::vector<vk::Image> images;
+    std::vector<vk::UniqueImageView> views;
+    /// one per swapchain image, presentation waits on it
+    std::vector<vk::UniqueSemaphore> renderFinished;
+    /// one per frame in flight, signalled by the acquire
+    std::vector<vk::UniqueSemaphore> imageAvailable;
+    ImageAllocation renderTarget;
+    vk::UniqueFramebuffer framebuffer;
+    /// the part of renderTarget that is rendered to
+    vk::Extent2D renderExtent;
+    /// swapchain needs a rebuild
+    bool dirty = false;
+    /// acquired imageIndex this frame, presents at the end of it
+    bool acquired = false;
+    uint32_t imageIndex = 0;
 };
 
 /**
@@ -52,6 +118,7 @@ struct ApplicationCreateInfo {
  * Init order is SDL->Vulkan 
  * Cleanup is the other way around
  * We use the c++ headers, so vulkan should clean itself up quite well
+ * All windows share the instance, device and queues. They are drawn in one submit and presented in one call.
  */
 class Application {
 public:
@@ -75,36 +142,121 @@ public:
      */
     virtual void handleEvent(const SDL_Event& e);
 
-private:
+    /// open another window on the same device. returns its SDL window id, throws std::runtime_error if it cannot be opened
+    Uint32 openWindow(const std::string& title, int x, int y, int w, int h);
+
+    /// close a window that is not the main window. It goes away once the gpu is done with it
+    void closeWindow(Uint32 id);
+
+    /// the compute queue. async if the device has a compute only family
+    ComputeQueue& compute();
+
+    /// the graphics queue timeline. Every frame submit signals the next value
+    GpuTimeline& graphicsTimeline();
+
+    /// make the next frame submit wait for w, i.e. for a compute batch
+    void waitBeforeFrame(const TimelineWait& w);
+
+    /// gpu time of the render passes of the last finished frame in ms, without the blits. 0 if timestamps are not supported
+    float gpuFrameMs() const;
+
+    /// the current render scale per axis
+    float renderScale() const;
+
+    /// frame capture, null if createInfo.capture is not enabled
+    FrameCapture* capture();
+
+    /// linear allocator for data only used by the frame being recorded. Reset at the start of every frame
+    /// Graphics queue only, the async compute queue must not read it
+    FrameAllocator& frameMemory();
+
+    /**
+     * \brief Keep object alive until the gpu is done with it
+     * Safe for anything used by the frame currently being recorded or earlier.
+     * Freed by polling the graphics timeline, nothing waits for it.
+     */
+    template <typename T>
+    void retire(T&& object)
+    {
+        retireQueue.retire(graphicsQueueTimeline, graphicsQueueTimeline.pending(), std::forward<T>(object));
+    }
+
+protected:
     /// inits all of the vulkan we need
     virtual void initVulkan();
     /// init the vulkan instance
     virtual void initVulkanInstance();
-    /// init the vulkan window surface
-    virtual void initVulkanSurface();
+    /// init the vulkan surface of a window. Throws std::runtime_error if SDL cannot create it
+    virtual void initVulkanSurface(WindowData& window);
     /// init (pick really) the vulkan physical device
     virtual void initVulkanPhysicalDevice();
     /// init the vulkan logical device
     virtual void initVulkanLogicalDevice();
-    /// init/rebuild the swap chain 
-    virtual void rebuildSwapchain();
+    /// init/rebuild the swap chain of a window
+    virtual void rebuildSwapchain(WindowData& window);
+    /// init the command pool, per frame data and the render pass
+    virtual void initFrames();
+    /// init per frame semaphores and the swapchain (or just the target if headless) of a window
+    virtual void initWindow(WindowData& window);
+    /// wait for a free frame, acquire, record, submit and present
+    virtual void drawFrame();
+    /// record the commands of a frame for every window in targets
+    virtual void recordFrame(vk::CommandBuffer commandBuffer, const std::vector<WindowData*>& targets);
+    /**
+     * \brief (Re)create the offscreen target of a window at full swapchain (or headless) size
+     * Only the top left renderExtent of it is rendered to, so scaling never recreates anything
+     */
+    virtual void rebuildRenderTarget(WindowData& window);
+    /// record the scene of window. Called inside renderPass, viewport and scissor are set to window.renderExtent
+    virtual void recordScene(vk::CommandBuffer commandBuffer, const WindowData& window);
+    /// scale the rendered part of the offscreen target up to the acquired swapchain image
+    void blitToSwapchain(vk::CommandBuffer commandBuffer, WindowData& window);
+    /// read the timestamps of the frame that used this slot before and update the render scale
+    void updateRenderScale();
+    /// acquire an image of window if it can be drawn to. the headless target always can
+    bool acquire(WindowData& window);
+    /// the window with SDL id, null if there is none
+    WindowData* findWindow(Uint32 id);
+    /// the first window, null if headless. for message boxes
+    SDL_Window* mainWindow() const;
+    /// report an error that ends the application. A message box over window, stderr if headless
+    void criticalError(const char* title, const char* message, SDL_Window* window) const;
 
-private:
+protected:
     ApplicationCreateInfo createInfo;
     bool running;
-    std::unique_ptr<SDL_Window, SdlDeleter> window;
     vk::UniqueInstance instance;
     vk::DispatchLoaderDynamic dlinstance;
     vk::DebugUtilsMessengerEXT debugMessenger;
-    vk::UniqueSurfaceKHR windowSurface;
     vk::PhysicalDevice physicalDevice;
     vk::UniqueDevice logicalDevice;
     vk::DispatchLoaderDynamic dldevice;
+    /// the main window (or headless target) is the first one. Cleared by the destructor before SDL_Quit
+    std::vector<std::unique_ptr<WindowData>> windows;
     vk::Queue graphicsQueue;
     vk::Queue presentQueue;
-    vk::UniqueSwapchainKHR swapchain;
-    std::vector<vk::Image> swapchainImages;
-    std::vector<vk::UniqueImageView> swapchainViews;
+    uint32_t graphicsFamily;
+    uint32_t presentFamily;
+    std::unique_ptr<ComputeQueue> computeQueue;
+    GpuTimeline graphicsQueueTimeline;
+    RetireQueue retireQueue;
+    vk::UniqueCommandPool commandPool;
+    std::vector<FrameData> frames;
+    uint32_t frameIndex;
+    std::vector<TimelineWait> frameWaits;
+    uint64_t frameCount;
+    /// all offscreen targets share this format, blits convert to the swapchain formats
+    vk::Format renderTargetFormat;
+    vk::UniqueRenderPass renderPass;
+    ResolutionController resolution;
+    /// two timestamps per frame in flight
+    vk::UniqueQueryPool timestampPool;
+    float timestampPeriod;
+    /// timestampValidBits of the graphics family as mask
+    uint64_t timestampMask;
+    float lastGpuMs;
+    std::unique_ptr<FrameCapture> frameCapture;
+    std::unique_ptr<FrameAllocator> frameAllocator;
 };
 
 #endif // _application_h
\ No newline at end of file
@@ -0,0 +1,295 @@
+/*
+    capture.cpp: Non blocking frame capture
+    Copyright (C) 2019 Malte Kieling
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "capture.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#else
+#include <csignal>
+#endif
+
+static bool isBgra(vk::Format format)
+{
+    return format == vk::Format::eB8G8R8A8Unorm
+        || format == vk::Format::eB8G8R8A8Srgb
+        || format == vk::Format::eB8G8R8A8Snorm;
+}
+
+FrameCapture::FrameCapture(const vk::PhysicalDevice& physicalDevice, const vk::Device& device, const CaptureInfo& info)
+    : physicalDevice(physicalDevice)
+    , device(device)
+    , captureInfo(info)
+    , frameCounter(0)
+    , captured(0)
+    , dropped(0)
+    , output(nullptr)
+    , failed(false)
+    , stopping(false)
+{
+    captureInfo.interval = std::max(1u, captureInfo.interval);
+    for (uint32_t i = 0; i < std::max(1u, captureInfo.ringSize); i++) {
+        slots.push_back(std::make_unique<Slot>());
+    }
+
+    switch (captureInfo.output) {
+    case CaptureOutput::RawStream:
+        output = std::fopen(captureInfo.target.c_str(), "wb");
+        break;
+    case CaptureOutput::Pipe:
+#ifndef _WIN32
+        // a reader that exits must not take us down with it, fwrite reports the error instead
+        std::signal(SIGPIPE, SIG_IGN);
+#endif
+        output = popen(captureInfo.target.c_str(), "w");
+        break;
+    default:
+        break;
+    }
+    if (captureInfo.output != CaptureOutput::PpmFiles && !output) {
+        throw std::runtime_error("Cannot open capture output " + captureInfo.target);
+    }
+
+    worker = std::thread(&FrameCapture::writeLoop, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueCondition.notify_all();
+    worker.join();
+
+    if (captureInfo.output == CaptureOutput::Pipe) {
+        pclose(output);
+    } else if (output) {
+        std::fclose(output);
+    }
+}
+
+bool FrameCapture::record(vk::CommandBuffer commandBuffer, vk::Image image, vk::Format format, const vk::Extent2D& extent, const GpuTimeline& timeline, uint64_t value)
+{
+    uint64_t frame = frameCounter++;
+    if (frame % captureInfo.interval != 0) {
+        return false;
+    }
+    if (failed) {
+        dropped++;
+        return false;
+    }
+    // streams have no header, every frame has to have the size of the first one
+    if (captureInfo.output != CaptureOutput::PpmFiles) {
+        if (streamExtent.width == 0) {
+            streamExtent = extent;
+        } else if (extent != streamExtent) {
+            dropped++;
+            return false;
+        }
+    }
+
+    auto slotIter = std::find_if(slots.begin(), slots.end(), [](const std::unique_ptr<Slot>& slot) {
+        return slot->state.load() == Free;
+    });
+    // never wait for the gpu or the disk, rather lose the frame
+    if (slotIter == slots.end()) {
+        dropped++;
+        return false;
+    }
+    auto& slot = **slotIter;
+
+    // free slots are not used by anyone, so growing them is fine
+    vk::DeviceSize size = static_cast<vk::DeviceSize>(extent.width) * extent.height * 4;
+    if (slot.buffer.size < size) {
+        slot.buffer = BufferAllocation();
+        try {
+            slot.buffer = createBuffer(
+                physicalDevice,
+                device,
+                size,
+                vk::BufferUsageFlagBits::eTransferDst,
+                vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCached);
+        } catch (std::runtime_error&) {
+            slot.buffer = createBuffer(
+                physicalDevice,
+                device,
+                size,
+                vk::BufferUsageFlagBits::eTransferDst,
+                vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+        }
+    }
+
+    vk::ImageSubresourceLayers layers(vk::ImageAspectFlagBits::eColor, 0, 0, 1);
+    vk::BufferImageCopy region(
+        0,
+        0,
+        0,
+        layers,
+        vk::Offset3D(0, 0, 0),
+        vk::Extent3D(extent.width, extent.height, 1));
+    commandBuffer.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, slot.buffer.buffer.get(), region);
+
+    vk::BufferMemoryBarrier toHost(
+        vk::AccessFlagBits::eTransferWrite,
+        vk::AccessFlagBits::eHostRead,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        slot.buffer.buffer.get(),
+        0,
+        size);
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eHost,
+        vk::DependencyFlags(),
+        nullptr,
+        toHost,
+        nullptr);
+
+    slot.extent = extent;
+    slot.bgra = isBgra(format);
+    slot.timeline = &timeline;
+    slot.value = value;
+    slot.frame = frame;
+    slot.state = Pending;
+    return true;
+}
+
+void FrameCapture::poll()
+{
+    std::vector<Slot*> done;
+    for (auto& slot : slots) {
+        if (slot->state.load() == Pending && slot->timeline->reached(slot->value)) {
+            done.push_back(slot.get());
+        }
+    }
+    if (done.empty()) {
+        return;
+    }
+
+    // the worker writes in frame order
+    std::sort(done.begin(), done.end(), [](const Slot* a, const Slot* b) {
+        return a->frame < b->frame;
+    });
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        for (auto slot : done) {
+            // cached memory is not coherent
+            device.invalidateMappedMemoryRanges(vk::MappedMemoryRange(slot->buffer.memory.get(), 0, VK_WHOLE_SIZE));
+            slot->state = Writing;
+            queue.push_back(slot);
+        }
+    }
+    queueCondition.notify_one();
+    captured += done.size();
+}
+
+uint64_t FrameCapture::capturedFrames() const
+{
+    return captured;
+}
+
+uint64_t FrameCapture::droppedFrames() const
+{
+    return dropped;
+}
+
+bool FrameCapture::writeFailed() const
+{
+    return failed;
+}
+
+void FrameCapture::writeLoop()
+{
+    while (true) {
+        Slot* slot = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [this]() { return stopping || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            slot = queue.front();
+            queue.pop_front();
+        }
+
+        write(*slot);
+        slot->state = Free;
+    }
+}
+
+void FrameCapture::write(Slot& slot)
+{
+    auto pixels = static_cast<const uint8_t*>(slot.buffer.mapped);
+    uint32_t width = slot.extent.width;
+    uint32_t height = slot.extent.height;
+
+    if (captureInfo.output == CaptureOutput::PpmFiles) {
+        std::string filename = captureInfo.target + "_" + std::to_string(slot.frame) + ".ppm";
+        std::FILE* file = std::fopen(filename.c_str(), "wb");
+        if (!file) {
+            failed = true;
+            return;
+        }
+
+        bool ok = std::fprintf(file, "P6\n%u %u\n255\n", width, height) > 0;
+        rowBuffer.resize(static_cast<size_t>(width) * 3);
+        for (uint32_t y = 0; y < height; y++) {
+            auto row = pixels + static_cast<size_t>(y) * width * 4;
+            for (uint32_t x = 0; x < width; x++) {
+                rowBuffer[x * 3 + 0] = row[x * 4 + (slot.bgra ? 2 : 0)];
+                rowBuffer[x * 3 + 1] = row[x * 4 + 1];
+                rowBuffer[x * 3 + 2] = row[x * 4 + (slot.bgra ? 0 : 2)];
+            }
+            ok = ok && std::fwrite(rowBuffer.data(), 1, rowBuffer.size(), file) == rowBuffer.size();
+        }
+        ok = std::fclose(file) == 0 && ok;
+        if (!ok) {
+            failed = true;
+        }
+        return;
+    }
+
+    // streams are always RGBA, so the reader does not need to know the swapchain format
+    size_t size = static_cast<size_t>(width) * height * 4;
+    if (!slot.bgra) {
+        if (std::fwrite(pixels, 1, size, output) != size) {
+            failed = true;
+        }
+        return;
+    }
+
+    rowBuffer.resize(static_cast<size_t>(width) * 4);
+    for (uint32_t y = 0; y < height; y++) {
+        auto row = pixels + static_cast<size_t>(y) * width * 4;
+        for (uint32_t x = 0; x < width; x++) {
+            rowBuffer[x * 4 + 0] = row[x * 4 + 2];
+            rowBuffer[x * 4 + 1] = row[x * 4 + 1];
+            rowBuffer[x * 4 + 2] = row[x * 4 + 0];
+            rowBuffer[x * 4 + 3] = row[x * 4 + 3];
+        }
+        if (std::fwrite(rowBuffer.data(), 1, rowBuffer.size(), output) != rowBuffer.size()) {
+            failed = true;
+            return;
+        }
+    }
+}
@@ -0,0 +1,130 @@
+/*
+    capture.h: Non blocking frame capture
+    Copyright (C) 2019 Malte Kieling
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _capture_h
+#define _capture_h
+
+#include "timeline.h"
+#include "util.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class CaptureOutput {
+    /// one binary PPM per frame, named <target>_<frame>.ppm
+    PpmFiles,
+    /// all frames back to back as raw 8 bit RGBA into the file target
+    RawStream,
+    /// raw 8 bit RGBA frames into the stdin of the command target (i.e. ffmpeg -f rawvideo ...)
+    /// Ignores SIGPIPE, a reader that went away shows up as writeFailed()
+    Pipe
+};
+
+struct CaptureInfo {
+    bool enabled = false;
+    CaptureOutput output = CaptureOutput::PpmFiles;
+    std::string target = "capture";
+    /// capture every nth frame
+    uint32_t interval = 1;
+    /// readback buffers. frames are dropped (not waited for) if all of them are busy
+    uint32_t ringSize = 3;
+};
+
+/**
+ * \brief Copies frames into a ring of host visible buffers and writes them on a worker thread
+ * record() adds the copy to a frame, poll() hands finished copies to the worker.
+ * Neither of them waits for the gpu or the worker.
+ * Images are expected to be 4 bytes per pixel, 8 bit RGBA or BGRA.
+ * Streams keep the size of the first captured frame, frames of another size are dropped.
+ */
+class FrameCapture {
+public:
+    FrameCapture(const vk::PhysicalDevice& physicalDevice, const vk::Device& device, const CaptureInfo& info);
+    /// waits for the worker to write everything it got
+    ~FrameCapture();
+
+    /**
+     * \brief Record a copy of the extent sized top left of image (in eTransferSrcOptimal)
+     * The copy is done once timeline reached value. Returns false if the frame was skipped or dropped
+     */
+    bool record(vk::CommandBuffer commandBuffer, vk::Image image, vk::Format format, const vk::Extent2D& extent, const GpuTimeline& timeline, uint64_t value);
+
+    /// hand all finished copies to the worker
+    void poll();
+
+    uint64_t capturedFrames() const;
+    /// frames skipped because no buffer was free, the size changed or writing failed
+    uint64_t droppedFrames() const;
+
+    /// a write failed (disk full, no such directory, pipe reader gone). Everything after is dropped
+    bool writeFailed() const;
+
+private:
+    enum SlotState {
+        Free,
+        /// copy recorded, gpu not done yet
+        Pending,
+        /// the worker is writing it
+        Writing
+    };
+
+    struct Slot {
+        BufferAllocation buffer;
+        std::atomic<int> state { Free };
+        vk::Extent2D extent;
+        bool bgra = false;
+        const GpuTimeline* timeline = nullptr;
+        uint64_t value = 0;
+        uint64_t frame = 0;
+    };
+
+    /// the worker thread
+    void writeLoop();
+    void write(Slot& slot);
+
+private:
+    vk::PhysicalDevice physicalDevice;
+    vk::Device device;
+    CaptureInfo captureInfo;
+    std::vector<std::unique_ptr<Slot>> slots;
+    uint64_t frameCounter;
+    uint64_t captured;
+    uint64_t dropped;
+    /// size of every frame in a stream, set by the first one
+    vk::Extent2D streamExtent;
+
+    std::FILE* output;
+    std::atomic<bool> failed;
+    std::vector<uint8_t> rowBuffer;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::deque<Slot*> queue;
+    bool stopping;
+    std::thread worker;
+};
+
+#endif //_capture_h
@@ -0,0 +1,166 @@
+/*
+    compute.cpp: Compute jobs on an (async) compute queue
+    Copyright (C) 2019 Malte Kieling
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "compute.h"
+
+ComputeQueue::ComputeQueue(const vk::Device& device, uint32_t family, vk::Queue queue, std::vector<uint32_t> sharingFamilies)
+    : device(device)
+    , queueFamily(family)
+    , queue(queue)
+    , families(std::move(sharingFamilies))
+    , queueTimeline(device)
+{
+    vk::CommandPoolCreateInfo poolInfo(
+        vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient,
+        queueFamily);
+    commandPool = device.createCommandPoolUnique(poolInfo);
+}
+
+ComputeQueue::~ComputeQueue()
+{
+    queueTimeline.wait(queueTimeline.lastSubmitted());
+}
+
+uint64_t ComputeQueue::submit(const ComputeBatch& batch)
+{
+    auto commandBuffer = getCommandBuffer();
+    commandBuffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+    vk::Pipeline boundPipeline;
+    for (const auto& job : batch.jobs) {
+        if (job.pipeline != boundPipeline) {
+            commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, job.pipeline);
+            boundPipeline = job.pipeline;
+        }
+        if (!job.descriptorSets.empty()) {
+            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, job.layout, 0, job.descriptorSets, nullptr);
+        }
+        if (!job.pushConstants.empty()) {
+            commandBuffer.pushConstants(
+                job.layout,
+                vk::ShaderStageFlagBits::eCompute,
+                0,
+                static_cast<uint32_t>(job.pushConstants.size()),
+                job.pushConstants.data());
+        }
+
+        commandBuffer.dispatch(job.groupCountX, job.groupCountY, job.groupCountZ);
+
+        // make the results visible to the rest of the batch
+        std::vector<vk::BufferMemoryBarrier> barriers;
+        for (auto buffer : job.writes) {
+            barriers.emplace_back(
+                vk::AccessFlagBits::eShaderWrite,
+                vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+                VK_QUEUE_FAMILY_IGNORED,
+                VK_QUEUE_FAMILY_IGNORED,
+                buffer,
+                0,
+                VK_WHOLE_SIZE);
+        }
+        if (!barriers.empty()) {
+            commandBuffer.pipelineBarrier(
+                vk::PipelineStageFlagBits::eComputeShader,
+                vk::PipelineStageFlagBits::eComputeShader,
+                vk::DependencyFlags(),
+                nullptr,
+                barriers,
+                nullptr);
+        }
+    }
+
+    commandBuffer.end();
+
+    TimelineSubmit submitData;
+    for (const auto& w : batch.waits) {
+        submitData.wait(w);
+    }
+    uint64_t value = queueTimeline.next();
+    submitData.signal({ queueTimeline.semaphore(), value });
+
+    std::vector<vk::CommandBuffer> commandBuffers = { commandBuffer };
+    queue.submit(submitData.get(commandBuffers), vk::Fence());
+
+    inFlight.back().first = value;
+    return value;
+}
+
+vk::UniquePipeline ComputeQueue::createPipeline(const std::vector<uint32_t>& spirv, vk::PipelineLayout layout, const char* entryPoint) const
+{
+    vk::ShaderModuleCreateInfo moduleInfo(
+        vk::ShaderModuleCreateFlags(),
+        spirv.size() * sizeof(uint32_t),
+        spirv.data());
+    auto shaderModule = device.createShaderModuleUnique(moduleInfo);
+
+    vk::PipelineShaderStageCreateInfo stageInfo(
+        vk::PipelineShaderStageCreateFlags(),
+        vk::ShaderStageFlagBits::eCompute,
+        shaderModule.get(),
+        entryPoint);
+    vk::ComputePipelineCreateInfo pipelineInfo(
+        vk::PipelineCreateFlags(),
+        stageInfo,
+        layout);
+
+    return std::move(device.createComputePipelineUnique(vk::PipelineCache(), pipelineInfo).value);
+}
+
+GpuTimeline& ComputeQueue::timeline()
+{
+    return queueTimeline;
+}
+
+uint32_t ComputeQueue::family() const
+{
+    return queueFamily;
+}
+
+bool ComputeQueue::isAsync() const
+{
+    return families.size() > 1;
+}
+
+const std::vector<uint32_t>& ComputeQueue::sharingFamilies() const
+{
+    return families;
+}
+
+vk::CommandBuffer ComputeQueue::getCommandBuffer()
+{
+    // recycle everything that finished, without waiting for anything
+    while (!inFlight.empty() && queueTimeline.reached(inFlight.front().first)) {
+        freeCommandBuffers.push_back(std::move(inFlight.front().second));
+        inFlight.pop_front();
+    }
+
+    vk::UniqueCommandBuffer commandBuffer;
+    if (!freeCommandBuffers.empty()) {
+        commandBuffer = std::move(freeCommandBuffers.back());
+        freeCommandBuffers.pop_back();
+        commandBuffer->reset(vk::CommandBufferResetFlags());
+    } else {
+        vk::CommandBufferAllocateInfo allocInfo(commandPool.get(), vk::CommandBufferLevel::ePrimary, 1);
+        commandBuffer = std::move(device.allocateCommandBuffersUnique(allocInfo)[0]);
+    }
+
+    // the value is filled in on submit
+    auto result = commandBuffer.get();
+    inFlight.emplace_back(std::numeric_limits<uint64_t>::max(), std::move(commandBuffer));
+    return result;
+}
@@ -0,0 +1,101 @@
+/*
+    compute.h: Compute jobs on an (async) compute queue
+    Copyright (C) 2019 Malte Kieling
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _compute_h
+#define _compute_h
+
+#include "timeline.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+/**
+ * \brief A single dispatch of a compute pipeline
+ * Buffers in writes get a barrier after the dispatch, so later jobs of the same batch can read them.
+ * Buffers shared with graphics should be created with all of ComputeQueue::sharingFamilies(),
+ * there is no queue family ownership transfer.
+ */
+struct ComputeJob {
+    vk::Pipeline pipeline;
+    vk::PipelineLayout layout;
+    std::vector<vk::DescriptorSet> descriptorSets;
+    std::vector<uint8_t> pushConstants;
+    uint32_t groupCountX = 1;
+    uint32_t groupCountY = 1;
+    uint32_t groupCountZ = 1;
+    std::vector<vk::Buffer> writes;
+};
+
+/**
+ * \brief A number of jobs that go into a single submit
+ * The batch waits for all of waits before it starts
+ */
+struct ComputeBatch {
+    std::vector<ComputeJob> jobs;
+    std::vector<TimelineWait> waits;
+
+    void add(const ComputeJob& job) { jobs.push_back(job); }
+    void waitFor(const TimelineWait& w) { waits.push_back(w); }
+};
+
+/**
+ * \brief A compute queue with its own timeline
+ * Uses a queue family without graphics if the device has one, otherwise the graphics queue.
+ * Every submit returns the timeline value it signals, graphics can wait on that with
+ * { timeline().semaphore(), value, eComputeShader/eVertexInput/... }.
+ */
+class ComputeQueue {
+public:
+    /// sharingFamilies are the unique graphics and compute families
+    ComputeQueue(const vk::Device& device, uint32_t family, vk::Queue queue, std::vector<uint32_t> sharingFamilies);
+    /// waits for all submits of this queue
+    ~ComputeQueue();
+
+    /// record all jobs of batch into one command buffer and submit it. returns the timeline value of the submit
+    uint64_t submit(const ComputeBatch& batch);
+
+    /// create a compute pipeline from SPIR-V
+    vk::UniquePipeline createPipeline(const std::vector<uint32_t>& spirv, vk::PipelineLayout layout, const char* entryPoint = "main") const;
+
+    GpuTimeline& timeline();
+    uint32_t family() const;
+    /// true if this is not the graphics queue
+    bool isAsync() const;
+    /// queue families that buffers used by both compute and graphics need to be shared with
+    const std::vector<uint32_t>& sharingFamilies() const;
+
+private:
+    /// get a command buffer whose previous submit is done, or allocate one
+    vk::CommandBuffer getCommandBuffer();
+
+private:
+    vk::Device device;
+    uint32_t queueFamily;
+    vk::Queue queue;
+    std::vector<uint32_t> families;
+    GpuTimeline queueTimeline;
+    vk::UniqueCommandPool commandPool;
+    /// submitted command buffers together with their timeline value, oldest first
+    std::deque<std::pair<uint64_t, vk::UniqueCommandBuffer>> inFlight;
+    std::vector<vk::UniqueCommandBuffer> freeCommandBuffers;
+};
+
+#endif //_compute_h
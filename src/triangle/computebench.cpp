@@ -0,0 +1,182 @@
+/*
+    computebench.cpp: Headless compute throughput
+    Copyright (C) 2019 Malte Kieling
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <SDL.h>
+
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <string>
+
+#include "application.h"
+#include "util.h"
+
+struct Particle {
+    float position[4];
+    float velocity[4];
+};
+
+struct StepConstants {
+    float dt;
+    uint32_t count;
+};
+
+/**
+ * \brief Integrates particles on the compute queue as fast as it can
+ * usage: computebench [particle count] [jobs per batch] [batches]
+ */
+class ComputeBench : public Application {
+public:
+    ComputeBench(const ApplicationCreateInfo& info, uint32_t particleCount, uint32_t jobsPerBatch, uint32_t batchCount)
+        : Application(info)
+        , particleCount(particleCount)
+        , jobsPerBatch(jobsPerBatch)
+        , batchCount(batchCount)
+    {
+        initParticles();
+        initPipeline();
+    }
+
+    void run() override
+    {
+        StepConstants constants = { 1.0f / 600.0f, particleCount };
+        ComputeJob job;
+        job.pipeline = pipeline.get();
+        job.layout = pipelineLayout.get();
+        job.descriptorSets = { descriptorSet };
+        job.pushConstants.resize(sizeof(constants));
+        memcpy(job.pushConstants.data(), &constants, sizeof(constants));
+        job.groupCountX = (particleCount + 255) / 256;
+        job.writes = { particles.buffer.get() };
+
+        ComputeBatch batch;
+        for (uint32_t i = 0; i < jobsPerBatch; i++) {
+            batch.add(job);
+        }
+
+        // two batches in flight, so the cpu records while the gpu works
+        auto& timeline = compute().timeline();
+        auto start = SDL_GetPerformanceCounter();
+        for (uint32_t i = 0; i < batchCount && running; i++) {
+            SDL_Event e;
+            while (SDL_PollEvent(&e)) {
+                handleEvent(e);
+            }
+
+            uint64_t value = compute().submit(batch);
+            if (value > 2) {
+                timeline.wait(value - 2);
+            }
+        }
+        timeline.wait(timeline.lastSubmitted());
+        auto end = SDL_GetPerformanceCounter();
+
+        double seconds = static_cast<double>(end - start) / static_cast<double>(SDL_GetPerformanceFrequency());
+        double jobs = static_cast<double>(jobsPerBatch) * static_cast<double>(batchCount);
+        std::cout << "compute queue: " << (compute().isAsync() ? "async" : "graphics") << std::endl;
+        std::cout << "batches: " << batchCount << " x " << jobsPerBatch << " jobs in " << seconds << "s" << std::endl;
+        std::cout << "jobs/s: " << jobs / seconds << std::endl;
+        std::cout << "particle updates/s: " << jobs * particleCount / seconds << std::endl;
+    }
+
+private:
+    void initParticles()
+    {
+        vk::DeviceSize size = sizeof(Particle) * particleCount;
+        auto usage = vk::BufferUsageFlagBits::eStorageBuffer;
+        // no staging here, prefer memory the gpu is fast with that we can still write
+        try {
+            particles = createBuffer(
+                physicalDevice,
+                logicalDevice.get(),
+                size,
+                usage,
+                vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                compute().sharingFamilies());
+        } catch (std::runtime_error&) {
+            particles = createBuffer(
+                physicalDevice,
+                logicalDevice.get(),
+                size,
+                usage,
+                vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                compute().sharingFamilies());
+        }
+
+        auto data = static_cast<Particle*>(particles.mapped);
+        for (uint32_t i = 0; i < particleCount; i++) {
+            data[i] = {
+                { static_cast<float>(i % 1024), 10.0f, static_cast<float>(i / 1024), 1.0f },
+                { 0.0f, 0.0f, 0.0f, 0.0f }
+            };
+        }
+    }
+
+    void initPipeline()
+    {
+        vk::DescriptorSetLayoutBinding binding(0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute);
+        vk::DescriptorSetLayoutCreateInfo setLayoutInfo(vk::DescriptorSetLayoutCreateFlags(), 1, &binding);
+        setLayout = logicalDevice->createDescriptorSetLayoutUnique(setLayoutInfo);
+
+        vk::PushConstantRange pushRange(vk::ShaderStageFlagBits::eCompute, 0, sizeof(StepConstants));
+        vk::PipelineLayoutCreateInfo layoutInfo(vk::PipelineLayoutCreateFlags(), 1, &setLayout.get(), 1, &pushRange);
+        pipelineLayout = logicalDevice->createPipelineLayoutUnique(layoutInfo);
+        pipeline = compute().createPipeline(readSpirv("particles.comp.spv"), pipelineLayout.get());
+
+        vk::DescriptorPoolSize poolSize(vk::DescriptorType::eStorageBuffer, 1);
+        vk::DescriptorPoolCreateInfo poolInfo(vk::DescriptorPoolCreateFlags(), 1, 1, &poolSize);
+        descriptorPool = logicalDevice->createDescriptorPoolUnique(poolInfo);
+        vk::DescriptorSetAllocateInfo allocInfo(descriptorPool.get(), 1, &setLayout.get());
+        descriptorSet = logicalDevice->allocateDescriptorSets(allocInfo)[0];
+
+        vk::DescriptorBufferInfo bufferInfo(particles.buffer.get(), 0, VK_WHOLE_SIZE);
+        vk::WriteDescriptorSet write(descriptorSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &bufferInfo);
+        logicalDevice->updateDescriptorSets(write, nullptr);
+    }
+
+private:
+    uint32_t particleCount;
+    uint32_t jobsPerBatch;
+    uint32_t batchCount;
+    BufferAllocation particles;
+    vk::UniqueDescriptorSetLayout setLayout;
+    vk::UniquePipelineLayout pipelineLayout;
+    vk::UniquePipeline pipeline;
+    vk::UniqueDescriptorPool descriptorPool;
+    vk::DescriptorSet descriptorSet;
+};
+
+int main(int argc, char** argv)
+{
+    try {
+        ApplicationCreateInfo info;
+        info.title = "Compute Bench";
+        info.headless = true;
+        info.enableValidation = false;
+        uint32_t particleCount = argc > 1 ? static_cast<uint32_t>(std::stoul(argv[1])) : 1024 * 1024;
+        uint32_t jobsPerBatch = argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : 16;
+        uint32_t batchCount = argc > 3 ? static_cast<uint32_t>(std::stoul(argv[3])) : 1000;
+        ComputeBench bench(info, particleCount, jobsPerBatch, batchCount);
+        bench.run();
+    } catch (std::exception& err) {
+        std::cerr << "Critical Error: " << err.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,257 @@
+/*
+    framealloc.cpp: Per frame linear allocator for transient gpu data
+    Copyright (C) 2019 Malte Kieling
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "framealloc.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+// the range of the dynamic descriptors, clamped to the device limits
+static constexpr vk::DeviceSize defaultBindSize = 64 * 1024;
+// vertex attributes and indirect commands are fine with this
+static constexpr vk::DeviceSize vertexAlignment = 16;
+
+// all of these alignments are powers of two
+static vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static vk::DeviceSize nextPowerOfTwo(vk::DeviceSize value)
+{
+    vk::DeviceSize result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+FrameAllocator::FrameAllocator(
+    const vk::PhysicalDevice& physicalDevice,
+    const vk::Device& device,
+    uint32_t framesInFlight,
+    vk::DeviceSize capacity,
+    const std::vector<uint32_t>& queueFamilies)
+    : physicalDevice(physicalDevice)
+    , device(device)
+    , families(queueFamilies)
+    , blockCapacity(std::max<vk::DeviceSize>(capacity, 1))
+    , current(0)
+    , highWater(0)
+    , spills(0)
+{
+    auto limits = physicalDevice.getProperties().limits;
+    uniformAlignment = std::max<vk::DeviceSize>(limits.minUniformBufferOffsetAlignment, 1);
+    storageAlignment = std::max<vk::DeviceSize>(limits.minStorageBufferOffsetAlignment, 1);
+    bindSize = std::min<vk::DeviceSize>({ defaultBindSize, limits.maxUniformBufferRange, limits.maxStorageBufferRange });
+
+    std::array<vk::DescriptorSetLayoutBinding, 2> bindings = {
+        vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eUniformBufferDynamic, 1, vk::ShaderStageFlagBits::eAllGraphics | vk::ShaderStageFlagBits::eCompute),
+        vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageBufferDynamic, 1, vk::ShaderStageFlagBits::eAllGraphics | vk::ShaderStageFlagBits::eCompute)
+    };
+    vk::DescriptorSetLayoutCreateInfo layoutInfo(
+        vk::DescriptorSetLayoutCreateFlags(),
+        static_cast<uint32_t>(bindings.size()),
+        bindings.data());
+    descriptorSetLayout = device.createDescriptorSetLayoutUnique(layoutInfo);
+
+    regions.resize(std::max(1u, framesInFlight));
+    for (auto& region : regions) {
+        region.block = createBlock(blockCapacity);
+    }
+}
+
+void FrameAllocator::reset(uint32_t frame)
+{
+    current = frame;
+    auto& region = regions[current];
+
+    // the frame that used this slot is done, so its blocks can go right away
+    if (!region.spills.empty()) {
+        blockCapacity = std::max(blockCapacity, nextPowerOfTwo(region.used));
+        region.spills.clear();
+    }
+    // other slots catch up with a grow the next time they come around
+    if (region.block.capacity < blockCapacity) {
+        // free the old one first, no need to have both around
+        region.block = Block();
+        region.block = createBlock(blockCapacity);
+    }
+
+    region.block.head = 0;
+    region.used = 0;
+}
+
+FrameAllocation FrameAllocator::allocateUniform(vk::DeviceSize size)
+{
+    if (size > bindSize) {
+        throw std::runtime_error("Uniform allocation larger than the bind range");
+    }
+    return allocate(size, uniformAlignment, 0);
+}
+
+FrameAllocation FrameAllocator::allocateStorage(vk::DeviceSize size)
+{
+    if (size > bindSize) {
+        throw std::runtime_error("Storage allocation larger than the bind range");
+    }
+    return allocate(size, storageAlignment, 1);
+}
+
+FrameAllocation FrameAllocator::allocateVertex(vk::DeviceSize size)
+{
+    return allocate(size, vertexAlignment, FrameAllocationNoBinding);
+}
+
+void FrameAllocator::bind(vk::CommandBuffer commandBuffer, vk::PipelineBindPoint bindPoint, vk::PipelineLayout layout, uint32_t set, const FrameAllocation& allocation) const
+{
+    // the offset of vertex data is not aligned for either binding
+    if (allocation.binding > 1 || !allocation.descriptorSet) {
+        throw std::runtime_error("Only uniform and storage frame allocations can be bound");
+    }
+    std::array<uint32_t, 2> offsets = { 0, 0 };
+    offsets[allocation.binding] = static_cast<uint32_t>(allocation.offset);
+    commandBuffer.bindDescriptorSets(bindPoint, layout, set, allocation.descriptorSet, offsets);
+}
+
+void FrameAllocator::bind(vk::CommandBuffer commandBuffer, vk::PipelineBindPoint bindPoint, vk::PipelineLayout layout, uint32_t set, const FrameAllocation& uniform, const FrameAllocation& storage) const
+{
+    if (uniform.binding != 0 || storage.binding != 1) {
+        throw std::runtime_error("Frame allocations are not uniform and storage data");
+    }
+    // one set per block, data of two blocks cannot be bound together
+    if (!uniform.descriptorSet || uniform.descriptorSet != storage.descriptorSet) {
+        throw std::runtime_error("Uniform and storage frame allocations are from different blocks");
+    }
+    std::array<uint32_t, 2> offsets = { static_cast<uint32_t>(uniform.offset), static_cast<uint32_t>(storage.offset) };
+    commandBuffer.bindDescriptorSets(bindPoint, layout, set, uniform.descriptorSet, offsets);
+}
+
+vk::DescriptorSetLayout FrameAllocator::setLayout() const
+{
+    return descriptorSetLayout.get();
+}
+
+vk::DeviceSize FrameAllocator::maxBindSize() const
+{
+    return bindSize;
+}
+
+vk::DeviceSize FrameAllocator::capacity() const
+{
+    return blockCapacity;
+}
+
+vk::DeviceSize FrameAllocator::used() const
+{
+    return regions[current].used;
+}
+
+vk::DeviceSize FrameAllocator::highWaterMark() const
+{
+    return highWater;
+}
+
+uint64_t FrameAllocator::spillCount() const
+{
+    return spills;
+}
+
+FrameAllocation FrameAllocator::allocate(vk::DeviceSize size, vk::DeviceSize alignment, uint32_t binding)
+{
+    auto& region = regions[current];
+    Block* block = region.spills.empty() ? &region.block : &region.spills.back();
+
+    vk::DeviceSize offset = alignUp(block->head, alignment);
+    if (offset + size > block->capacity) {
+        // never wait or move what is already handed out, just continue in a new block
+        region.spills.push_back(createBlock(std::max(blockCapacity, size)));
+        block = &region.spills.back();
+        offset = 0;
+        spills++;
+    }
+
+    region.used += offset + size - block->head;
+    block->head = offset + size;
+    highWater = std::max(highWater, region.used);
+
+    FrameAllocation result;
+    result.buffer = block->buffer.buffer.get();
+    result.offset = offset;
+    result.size = size;
+    result.data = static_cast<uint8_t*>(block->buffer.mapped) + offset;
+    result.descriptorSet = binding == FrameAllocationNoBinding ? vk::DescriptorSet() : block->descriptorSet;
+    result.binding = binding;
+    return result;
+}
+
+FrameAllocator::Block FrameAllocator::createBlock(vk::DeviceSize blockSize)
+{
+    Block block;
+    block.capacity = blockSize;
+
+    // the descriptors always cover bindSize, so offsets up to the capacity have to stay in the buffer
+    vk::DeviceSize size = blockSize + bindSize;
+    auto usage = vk::BufferUsageFlagBits::eUniformBuffer
+        | vk::BufferUsageFlagBits::eStorageBuffer
+        | vk::BufferUsageFlagBits::eVertexBuffer
+        | vk::BufferUsageFlagBits::eIndexBuffer
+        | vk::BufferUsageFlagBits::eIndirectBuffer
+        | vk::BufferUsageFlagBits::eTransferSrc;
+    // written once and read once, so prefer memory the gpu is fast with if the cpu can still map it
+    try {
+        block.buffer = createBuffer(
+            physicalDevice,
+            device,
+            size,
+            usage,
+            vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+            families);
+    } catch (std::runtime_error&) {
+        block.buffer = createBuffer(
+            physicalDevice,
+            device,
+            size,
+            usage,
+            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+            families);
+    }
+
+    std::array<vk::DescriptorPoolSize, 2> poolSizes = {
+        vk::DescriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, 1),
+        vk::DescriptorPoolSize(vk::DescriptorType::eStorageBufferDynamic, 1)
+    };
+    vk::DescriptorPoolCreateInfo poolInfo(
+        vk::DescriptorPoolCreateFlags(),
+        1,
+        static_cast<uint32_t>(poolSizes.size()),
+        poolSizes.data());
+    block.descriptorPool = device.createDescriptorPoolUnique(poolInfo);
+    vk::DescriptorSetAllocateInfo allocInfo(block.descriptorPool.get(), 1, &descriptorSetLayout.get());
+    block.descriptorSet = device.allocateDescriptorSets(allocInfo)[0];
+
+    vk::DescriptorBufferInfo bufferInfo(block.buffer.buffer.get(), 0, bindSize);
+    std::array<vk::WriteDescriptorSet, 2> writes = {
+        vk::WriteDescriptorSet(block.descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBufferDynamic, nullptr, &bufferInfo),
+        vk::WriteDescriptorSet(block.descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBufferDynamic, nullptr, &bufferInfo)
+    };
+    device.updateDescriptorSets(writes, nullptr);
+
+    return block;
+}
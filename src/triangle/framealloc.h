@@ -0,0 +1,141 @@
+/*
+    framealloc.h: Per frame linear allocator for transient gpu data
+    Copyright (C) 2019 Malte Kieling
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _framealloc_h
+#define _framealloc_h
+
+#include "util.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/// binding of allocations that are not bound through the descriptor set (vertex data)
+static constexpr uint32_t FrameAllocationNoBinding = ~0u;
+
+/// a piece of frame memory. Only valid until the frame it was allocated in is done on the gpu
+struct FrameAllocation {
+    vk::Buffer buffer;
+    /// offset into buffer. The dynamic offset when binding descriptorSet
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize size = 0;
+    /// persistently mapped and coherent, just write to it
+    void* data = nullptr;
+    /// dynamic uniform buffer (binding 0) and storage buffer (binding 1) of the block this is in. Null for vertex data
+    vk::DescriptorSet descriptorSet;
+    /// 0 for uniform, 1 for storage data, FrameAllocationNoBinding for vertex data
+    uint32_t binding = FrameAllocationNoBinding;
+};
+
+/**
+ * \brief Bump allocator over one large persistently mapped buffer per frame in flight
+ * reset() starts a frame by moving the head back to 0. Callers make sure the frame that used the slot
+ * before is done, the Application does that with the graphics timeline.
+ * A frame that runs out of space spills into an extra block, and the next reset of that slot grows
+ * the buffer to fit. High water mark and spill count tell how large the buffer should have been.
+ * With more than one queueFamilies the buffers are shared, and the caller has to wait for the work of all
+ * of those queues that used a slot before resetting it.
+ */
+class FrameAllocator {
+public:
+    FrameAllocator(
+        const vk::PhysicalDevice& physicalDevice,
+        const vk::Device& device,
+        uint32_t framesInFlight,
+        vk::DeviceSize capacity,
+        const std::vector<uint32_t>& queueFamilies = {});
+
+    /// start allocating for frame. O(1) unless the slot spilled or has to grow
+    void reset(uint32_t frame);
+
+    /// aligned to minUniformBufferOffsetAlignment. At most maxBindSize()
+    FrameAllocation allocateUniform(vk::DeviceSize size);
+    /// aligned to minStorageBufferOffsetAlignment. At most maxBindSize()
+    FrameAllocation allocateStorage(vk::DeviceSize size);
+    /// vertex, index or indirect data, or the source of an upload. Any size
+    FrameAllocation allocateVertex(vk::DeviceSize size);
+
+    /// allocate and fill a uniform
+    template <typename T>
+    FrameAllocation uniform(const T& value)
+    {
+        auto allocation = allocateUniform(sizeof(T));
+        memcpy(allocation.data, &value, sizeof(T));
+        return allocation;
+    }
+
+    /// bind the set of allocation with its offset as dynamic offset. The other binding gets 0. Throws for vertex data
+    void bind(vk::CommandBuffer commandBuffer, vk::PipelineBindPoint bindPoint, vk::PipelineLayout layout, uint32_t set, const FrameAllocation& allocation) const;
+    /// bind uniform and storage data of the same block at once. Throws if they are not from one block
+    void bind(vk::CommandBuffer commandBuffer, vk::PipelineBindPoint bindPoint, vk::PipelineLayout layout, uint32_t set, const FrameAllocation& uniform, const FrameAllocation& storage) const;
+
+    /// layout of the descriptor sets, to put into pipeline layouts
+    vk::DescriptorSetLayout setLayout() const;
+
+    /// range of the dynamic descriptors, the largest uniform or storage allocation
+    vk::DeviceSize maxBindSize() const;
+
+    /// bytes per frame before spilling
+    vk::DeviceSize capacity() const;
+
+    /// bytes used by the current frame
+    vk::DeviceSize used() const;
+
+    /// most bytes (including alignment) any frame used
+    vk::DeviceSize highWaterMark() const;
+
+    /// allocations that did not fit and went to a spill block
+    uint64_t spillCount() const;
+
+private:
+    struct Block {
+        BufferAllocation buffer;
+        vk::UniqueDescriptorPool descriptorPool;
+        vk::DescriptorSet descriptorSet;
+        vk::DeviceSize capacity = 0;
+        vk::DeviceSize head = 0;
+    };
+
+    /// the blocks of one frame in flight. Spills are only used until the next reset
+    struct Region {
+        Block block;
+        std::vector<Block> spills;
+        vk::DeviceSize used = 0;
+    };
+
+    FrameAllocation allocate(vk::DeviceSize size, vk::DeviceSize alignment, uint32_t binding);
+    Block createBlock(vk::DeviceSize blockSize);
+
+private:
+    vk::PhysicalDevice physicalDevice;
+    vk::Device device;
+    std::vector<uint32_t> families;
+    vk::DeviceSize uniformAlignment;
+    vk::DeviceSize storageAlignment;
+    vk::DeviceSize bindSize;
+    vk::DeviceSize blockCapacity;
+    vk::UniqueDescriptorSetLayout descriptorSetLayout;
+    std::vector<Region> regions;
+    uint32_t current;
+    vk::DeviceSize highWater;
+    uint64_t spills;
+};
+
+#endif //_framealloc_h
@@ -0,0 +1,77 @@
+/*
+    resolution.cpp: Dynamic resolution scaling
+    Copyright (C) 2019 Malte Kieling
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "resolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+// how fast the smoothed time follows new samples
+static constexpr float smoothing = 0.1f;
+// stay put while the gpu time is within [low, high] * target
+static constexpr float deadBandLow = 0.8f;
+static constexpr float deadBandHigh = 0.95f;
+// aim a bit below the target to have some headroom
+static constexpr float aim = 0.875f;
+// largest relative change per frame
+static constexpr float maxStep = 0.05f;
+
+ResolutionController::ResolutionController(float targetMs, float minScale, float maxScale)
+    : targetMs(targetMs)
+    , minScale(minScale)
+    , maxScale(maxScale)
+    , currentScale(maxScale)
+    , smoothed(0.0f)
+    , hasSample(false)
+{
+}
+
+float ResolutionController::update(float gpuMs)
+{
+    smoothed = hasSample ? smoothed + (gpuMs - smoothed) * smoothing : gpuMs;
+    hasSample = true;
+
+    if (smoothed <= 0.0f) {
+        return currentScale;
+    }
+    if (smoothed >= targetMs * deadBandLow && smoothed <= targetMs * deadBandHigh) {
+        return currentScale;
+    }
+
+    float wanted = currentScale * std::sqrt(targetMs * aim / smoothed);
+    wanted = std::clamp(wanted, currentScale * (1.0f - maxStep), currentScale * (1.0f + maxStep));
+    currentScale = std::clamp(wanted, minScale, maxScale);
+    return currentScale;
+}
+
+float ResolutionController::scale() const
+{
+    return currentScale;
+}
+
+float ResolutionController::smoothedMs() const
+{
+    return smoothed;
+}
+
+vk::Extent2D ResolutionController::apply(const vk::Extent2D& full) const
+{
+    return vk::Extent2D(
+        std::max(1u, static_cast<uint32_t>(static_cast<float>(full.width) * currentScale)),
+        std::max(1u, static_cast<uint32_t>(static_cast<float>(full.height) * currentScale)));
+}
@@ -0,0 +1,53 @@
+/*
+    resolution.h: Dynamic resolution scaling
+    Copyright (C) 2019 Malte Kieling
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _resolution_h
+#define _resolution_h
+
+#include <vulkan/vulkan.hpp>
+
+/**
+ * \brief Picks a render scale from measured gpu frame times
+ * The scale is per axis, so gpu time is assumed to follow its square.
+ * Inside the dead band around the target nothing changes, so the image does not swim.
+ */
+class ResolutionController {
+public:
+    ResolutionController(float targetMs = 16.0f, float minScale = 0.5f, float maxScale = 1.0f);
+
+    /// feed the gpu time of a finished frame. returns the new scale
+    float update(float gpuMs);
+
+    float scale() const;
+
+    /// the smoothed gpu time the scale is based on
+    float smoothedMs() const;
+
+    /// the part of full that is rendered to. at least 1x1
+    vk::Extent2D apply(const vk::Extent2D& full) const;
+
+private:
+    float targetMs;
+    float minScale;
+    float maxScale;
+    float currentScale;
+    float smoothed;
+    bool hasSample;
+};
+
+#endif //_resolution_h
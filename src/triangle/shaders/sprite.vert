@@ -0,0 +1,29 @@
+#version 450
+
+// one quad per instance. The corners come from the vertex index of a 4 vertex triangle strip
+layout(location = 0) in vec4 rect;
+layout(location = 1) in float rotation;
+layout(location = 2) in uint layer;
+layout(location = 3) in vec4 color;
+
+// 2 / target size, maps pixels with the origin top left to clip space
+layout(push_constant) uniform View {
+    vec2 scale;
+} view;
+
+layout(location = 0) out vec3 uv;
+layout(location = 1) out vec4 tint;
+
+void main()
+{
+    vec2 corner = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1);
+    // rect is center and size in pixels
+    vec2 local = (corner - 0.5) * rect.zw;
+    float s = sin(rotation);
+    float c = cos(rotation);
+    vec2 pixel = rect.xy + vec2(c * local.x - s * local.y, s * local.x + c * local.y);
+
+    gl_Position = vec4(pixel * view.scale - 1.0, 0.0, 1.0);
+    uv = vec3(corner, float(layer));
+    tint = color;
+}
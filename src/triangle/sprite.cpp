@@ -0,0 +1,381 @@
+/*
+    sprite.cpp: Batched textured quads
+    Copyright (C) 2019 Malte Kieling
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "sprite.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+// the key is z, blend mode and texture from high to low byte. The batch breaks when the top 16 bits change
+static uint32_t sortKey(const Sprite& sprite)
+{
+    return (static_cast<uint32_t>(sprite.z) << 24)
+        | (static_cast<uint32_t>(sprite.blend) << 16)
+        | (sprite.texture & 0xffff);
+}
+
+SpriteBatch::SpriteBatch(const vk::PhysicalDevice& physicalDevice, const vk::Device& device, vk::RenderPass renderPass, FrameAllocator& frameMemory)
+    : physicalDevice(physicalDevice)
+    , device(device)
+    , frameMemory(frameMemory)
+    , texturesReady(false)
+    , lastDrawCalls(0)
+{
+    vk::SamplerCreateInfo samplerInfo(
+        vk::SamplerCreateFlags(),
+        vk::Filter::eLinear,
+        vk::Filter::eLinear,
+        vk::SamplerMipmapMode::eNearest,
+        vk::SamplerAddressMode::eClampToEdge,
+        vk::SamplerAddressMode::eClampToEdge,
+        vk::SamplerAddressMode::eClampToEdge);
+    sampler = device.createSamplerUnique(samplerInfo);
+
+    vk::DescriptorSetLayoutBinding binding(0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment);
+    vk::DescriptorSetLayoutCreateInfo setLayoutInfo(vk::DescriptorSetLayoutCreateFlags(), 1, &binding);
+    setLayout = device.createDescriptorSetLayoutUnique(setLayoutInfo);
+
+    vk::PushConstantRange pushRange(vk::ShaderStageFlagBits::eVertex, 0, sizeof(std::array<float, 2>));
+    vk::PipelineLayoutCreateInfo layoutInfo(vk::PipelineLayoutCreateFlags(), 1, &setLayout.get(), 1, &pushRange);
+    pipelineLayout = device.createPipelineLayoutUnique(layoutInfo);
+
+    vk::DescriptorPoolSize poolSize(vk::DescriptorType::eCombinedImageSampler, 1);
+    vk::DescriptorPoolCreateInfo poolInfo(vk::DescriptorPoolCreateFlags(), 1, 1, &poolSize);
+    descriptorPool = device.createDescriptorPoolUnique(poolInfo);
+    vk::DescriptorSetAllocateInfo allocInfo(descriptorPool.get(), 1, &setLayout.get());
+    descriptorSet = device.allocateDescriptorSets(allocInfo)[0];
+
+    initPipelines(renderPass);
+}
+
+void SpriteBatch::setTextures(uint32_t width, uint32_t height, const std::vector<std::vector<uint32_t>>& layers)
+{
+    if (textures.image) {
+        throw std::runtime_error("Sprite textures can only be set once");
+    }
+
+    uint32_t layerCount = std::max(1u, static_cast<uint32_t>(layers.size()));
+    textures = createImage(
+        physicalDevice,
+        device,
+        vk::Extent2D(width, height),
+        vk::Format::eR8G8B8A8Unorm,
+        vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+        layerCount);
+    // the shader samples an array, a single layer gets a plain 2D view from createImage
+    if (layerCount == 1) {
+        vk::ImageViewCreateInfo viewInfo(
+            vk::ImageViewCreateFlags(),
+            textures.image.get(),
+            vk::ImageViewType::e2DArray,
+            textures.format,
+            vk::ComponentMapping(),
+            vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+        textures.view = device.createImageViewUnique(viewInfo);
+    }
+
+    size_t layerSize = static_cast<size_t>(width) * height;
+    pendingPixels.reserve(layerSize * layerCount);
+    for (const auto& layer : layers) {
+        if (layer.size() != layerSize) {
+            throw std::runtime_error("Sprite texture layer has the wrong size");
+        }
+        pendingPixels.insert(pendingPixels.end(), layer.begin(), layer.end());
+    }
+    // no textures at all is plain white, so tints still work
+    if (layers.empty()) {
+        pendingPixels.resize(layerSize, 0xffffffff);
+    }
+
+    vk::DescriptorImageInfo imageInfo(sampler.get(), textures.view.get(), vk::ImageLayout::eShaderReadOnlyOptimal);
+    vk::WriteDescriptorSet write(descriptorSet, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &imageInfo);
+    device.updateDescriptorSets(write, nullptr);
+}
+
+void SpriteBatch::upload(vk::CommandBuffer commandBuffer)
+{
+    if (pendingPixels.empty()) {
+        return;
+    }
+
+    // frame memory is staging memory as well, it is reused once this frame is done
+    vk::DeviceSize size = pendingPixels.size() * sizeof(uint32_t);
+    auto staging = frameMemory.allocateVertex(size);
+    memcpy(staging.data, pendingPixels.data(), size);
+    uint32_t layerCount = static_cast<uint32_t>(pendingPixels.size() / (static_cast<size_t>(textures.extent.width) * textures.extent.height));
+
+    vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, 1, 0, layerCount);
+    vk::ImageMemoryBarrier toCopy(
+        vk::AccessFlags(),
+        vk::AccessFlagBits::eTransferWrite,
+        vk::ImageLayout::eUndefined,
+        vk::ImageLayout::eTransferDstOptimal,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        textures.image.get(),
+        range);
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTopOfPipe,
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::DependencyFlags(),
+        nullptr,
+        nullptr,
+        toCopy);
+
+    // the layers are tightly packed one after the other, so this is one copy
+    vk::ImageSubresourceLayers layers(vk::ImageAspectFlagBits::eColor, 0, 0, layerCount);
+    vk::BufferImageCopy region(
+        staging.offset,
+        0,
+        0,
+        layers,
+        vk::Offset3D(0, 0, 0),
+        vk::Extent3D(textures.extent.width, textures.extent.height, 1));
+    commandBuffer.copyBufferToImage(staging.buffer, textures.image.get(), vk::ImageLayout::eTransferDstOptimal, region);
+
+    vk::ImageMemoryBarrier toShader(
+        vk::AccessFlagBits::eTransferWrite,
+        vk::AccessFlagBits::eShaderRead,
+        vk::ImageLayout::eTransferDstOptimal,
+        vk::ImageLayout::eShaderReadOnlyOptimal,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        textures.image.get(),
+        range);
+    commandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eFragmentShader,
+        vk::DependencyFlags(),
+        nullptr,
+        nullptr,
+        toShader);
+
+    pendingPixels.clear();
+    pendingPixels.shrink_to_fit();
+    texturesReady = true;
+}
+
+void SpriteBatch::add(const Sprite& sprite)
+{
+    uint32_t index = static_cast<uint32_t>(instances.size());
+    instances.push_back({ { sprite.x, sprite.y, sprite.w, sprite.h }, sprite.rotation, sprite.texture, sprite.color });
+    keys.push_back((static_cast<uint64_t>(sortKey(sprite)) << 32) | index);
+}
+
+size_t SpriteBatch::size() const
+{
+    return instances.size();
+}
+
+void SpriteBatch::draw(vk::CommandBuffer commandBuffer, const vk::Extent2D& targetSize)
+{
+    lastDrawCalls = 0;
+    if (instances.empty() || !texturesReady) {
+        instances.clear();
+        keys.clear();
+        return;
+    }
+
+    sort();
+
+    // written front to back in draw order, which is what write combined memory likes
+    uint32_t count = static_cast<uint32_t>(instances.size());
+    auto allocation = frameMemory.allocateVertex(sizeof(Instance) * count);
+    auto data = static_cast<Instance*>(allocation.data);
+    for (uint32_t i = 0; i < count; i++) {
+        data[i] = instances[keys[i] & 0xffffffff];
+    }
+
+    std::array<float, 2> scale = {
+        2.0f / static_cast<float>(targetSize.width),
+        2.0f / static_cast<float>(targetSize.height)
+    };
+    commandBuffer.bindVertexBuffers(0, allocation.buffer, allocation.offset);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout.get(), 0, descriptorSet, nullptr);
+    commandBuffer.pushConstants(pipelineLayout.get(), vk::ShaderStageFlagBits::eVertex, 0, sizeof(scale), scale.data());
+
+    // one instanced draw per run of equal z and blend mode
+    uint32_t bound = std::numeric_limits<uint32_t>::max();
+    uint32_t first = 0;
+    while (first < count) {
+        uint64_t run = keys[first] >> 48;
+        uint32_t last = first + 1;
+        while (last < count && keys[last] >> 48 == run) {
+            last++;
+        }
+
+        uint32_t blend = static_cast<uint32_t>(run & 0xff);
+        if (blend != bound) {
+            commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines[blend].get());
+            bound = blend;
+        }
+        commandBuffer.draw(4, last - first, 0, first);
+        lastDrawCalls++;
+        first = last;
+    }
+
+    instances.clear();
+    keys.clear();
+}
+
+uint32_t SpriteBatch::drawCalls() const
+{
+    return lastDrawCalls;
+}
+
+void SpriteBatch::initPipelines(vk::RenderPass renderPass)
+{
+    auto vertexSpirv = readSpirv("sprite.vert.spv");
+    auto fragmentSpirv = readSpirv("sprite.frag.spv");
+    auto vertexModule = device.createShaderModuleUnique(vk::ShaderModuleCreateInfo(
+        vk::ShaderModuleCreateFlags(),
+        vertexSpirv.size() * sizeof(uint32_t),
+        vertexSpirv.data()));
+    auto fragmentModule = device.createShaderModuleUnique(vk::ShaderModuleCreateInfo(
+        vk::ShaderModuleCreateFlags(),
+        fragmentSpirv.size() * sizeof(uint32_t),
+        fragmentSpirv.data()));
+    std::array<vk::PipelineShaderStageCreateInfo, 2> stages = {
+        vk::PipelineShaderStageCreateInfo(vk::PipelineShaderStageCreateFlags(), vk::ShaderStageFlagBits::eVertex, vertexModule.get(), "main"),
+        vk::PipelineShaderStageCreateInfo(vk::PipelineShaderStageCreateFlags(), vk::ShaderStageFlagBits::eFragment, fragmentModule.get(), "main")
+    };
+
+    // no vertex buffer, just instances
+    vk::VertexInputBindingDescription binding(0, sizeof(Instance), vk::VertexInputRate::eInstance);
+    std::array<vk::VertexInputAttributeDescription, 4> attributes = {
+        vk::VertexInputAttributeDescription(0, 0, vk::Format::eR32G32B32A32Sfloat, offsetof(Instance, rect)),
+        vk::VertexInputAttributeDescription(1, 0, vk::Format::eR32Sfloat, offsetof(Instance, rotation)),
+        vk::VertexInputAttributeDescription(2, 0, vk::Format::eR32Uint, offsetof(Instance, layer)),
+        vk::VertexInputAttributeDescription(3, 0, vk::Format::eR8G8B8A8Unorm, offsetof(Instance, color))
+    };
+    vk::PipelineVertexInputStateCreateInfo vertexInput(
+        vk::PipelineVertexInputStateCreateFlags(),
+        1,
+        &binding,
+        static_cast<uint32_t>(attributes.size()),
+        attributes.data());
+    vk::PipelineInputAssemblyStateCreateInfo inputAssembly(vk::PipelineInputAssemblyStateCreateFlags(), vk::PrimitiveTopology::eTriangleStrip);
+
+    // the Application sets both for every target
+    vk::PipelineViewportStateCreateInfo viewportState(vk::PipelineViewportStateCreateFlags(), 1, nullptr, 1, nullptr);
+    std::array<vk::DynamicState, 2> dynamicStates = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+    vk::PipelineDynamicStateCreateInfo dynamicState(
+        vk::PipelineDynamicStateCreateFlags(),
+        static_cast<uint32_t>(dynamicStates.size()),
+        dynamicStates.data());
+
+    vk::PipelineRasterizationStateCreateInfo rasterization(
+        vk::PipelineRasterizationStateCreateFlags(),
+        false,
+        false,
+        vk::PolygonMode::eFill,
+        vk::CullModeFlagBits::eNone,
+        vk::FrontFace::eCounterClockwise,
+        false,
+        0.0f,
+        0.0f,
+        0.0f,
+        1.0f);
+    vk::PipelineMultisampleStateCreateInfo multisample;
+
+    auto colorMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
+    std::array<vk::PipelineColorBlendAttachmentState, 2> blendModes = {
+        // SpriteBlend::Alpha
+        vk::PipelineColorBlendAttachmentState(
+            true,
+            vk::BlendFactor::eSrcAlpha,
+            vk::BlendFactor::eOneMinusSrcAlpha,
+            vk::BlendOp::eAdd,
+            vk::BlendFactor::eOne,
+            vk::BlendFactor::eOneMinusSrcAlpha,
+            vk::BlendOp::eAdd,
+            colorMask),
+        // SpriteBlend::Additive
+        vk::PipelineColorBlendAttachmentState(
+            true,
+            vk::BlendFactor::eSrcAlpha,
+            vk::BlendFactor::eOne,
+            vk::BlendOp::eAdd,
+            vk::BlendFactor::eZero,
+            vk::BlendFactor::eOne,
+            vk::BlendOp::eAdd,
+            colorMask)
+    };
+
+    for (const auto& blendMode : blendModes) {
+        vk::PipelineColorBlendStateCreateInfo colorBlend(
+            vk::PipelineColorBlendStateCreateFlags(),
+            false,
+            vk::LogicOp::eCopy,
+            1,
+            &blendMode);
+        vk::GraphicsPipelineCreateInfo pipelineInfo(
+            vk::PipelineCreateFlags(),
+            static_cast<uint32_t>(stages.size()),
+            stages.data(),
+            &vertexInput,
+            &inputAssembly,
+            nullptr,
+            &viewportState,
+            &rasterization,
+            &multisample,
+            nullptr,
+            &colorBlend,
+            &dynamicState,
+            pipelineLayout.get(),
+            renderPass,
+            0);
+        pipelines.push_back(std::move(device.createGraphicsPipelineUnique(vk::PipelineCache(), pipelineInfo).value));
+    }
+}
+
+void SpriteBatch::sort()
+{
+    // lsd radix sort over the 4 key bytes. Stable, so equal keys stay in the order they were added
+    std::array<std::array<uint32_t, 256>, 4> histograms = {};
+    for (auto entry : keys) {
+        for (int pass = 0; pass < 4; pass++) {
+            histograms[pass][(entry >> (32 + pass * 8)) & 0xff]++;
+        }
+    }
+
+    sortScratch.resize(keys.size());
+    for (int pass = 0; pass < 4; pass++) {
+        int shift = 32 + pass * 8;
+        auto& histogram = histograms[pass];
+        // every key has the same byte here, the usual case for z and blend mode
+        if (histogram[(keys[0] >> shift) & 0xff] == keys.size()) {
+            continue;
+        }
+
+        uint32_t offset = 0;
+        for (auto& count : histogram) {
+            uint32_t bucket = count;
+            count = offset;
+            offset += bucket;
+        }
+        for (auto entry : keys) {
+            sortScratch[histogram[(entry >> shift) & 0xff]++] = entry;
+        }
+        keys.swap(sortScratch);
+    }
+}
@@ -0,0 +1,116 @@
+/*
+    sprite.h: Batched textured quads
+    Copyright (C) 2019 Malte Kieling
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _sprite_h
+#define _sprite_h
+
+#include "framealloc.h"
+#include "util.h"
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/// how a sprite is blended. Every mode is a pipeline, so a change breaks the batch
+enum class SpriteBlend : uint8_t {
+    Alpha,
+    Additive
+};
+
+struct Sprite {
+    /// center and size in pixels, origin top left
+    float x = 0.0f;
+    float y = 0.0f;
+    float w = 0.0f;
+    float h = 0.0f;
+    /// radians, clockwise
+    float rotation = 0.0f;
+    /// layer of the texture array
+    uint32_t texture = 0;
+    /// tint, 8 bit RGBA with r in the lowest byte
+    uint32_t color = 0xffffffff;
+    /// draw order, higher is on top. Same z is drawn in no particular order
+    uint8_t z = 0;
+    SpriteBlend blend = SpriteBlend::Alpha;
+};
+
+/**
+ * \brief Collects sprites for a frame and draws them with a handful of instanced draws
+ * draw() radix sorts by z, blend mode and texture, writes the instances in that order into frame memory
+ * and issues one draw per run of equal z and blend mode. All textures live in one texture array.
+ */
+class SpriteBatch {
+public:
+    /// renderPass is the one pipelines are created for, frameMemory holds the instances and texture uploads
+    SpriteBatch(const vk::PhysicalDevice& physicalDevice, const vk::Device& device, vk::RenderPass renderPass, FrameAllocator& frameMemory);
+
+    /// create the texture array, once. layers are width * height RGBA8 pixels each. Uploaded by the next upload()
+    void setTextures(uint32_t width, uint32_t height, const std::vector<std::vector<uint32_t>>& layers);
+
+    /// record pending texture uploads. Outside of a render pass, before draw()
+    void upload(vk::CommandBuffer commandBuffer);
+
+    void add(const Sprite& sprite);
+
+    /// sprites added since the last draw
+    size_t size() const;
+
+    /**
+     * \brief Record the draws of everything added and clear the batch
+     * Inside a render pass with viewport and scissor set. targetSize is what the sprite coordinates refer to
+     */
+    void draw(vk::CommandBuffer commandBuffer, const vk::Extent2D& targetSize);
+
+    /// draw calls recorded by the last draw()
+    uint32_t drawCalls() const;
+
+private:
+    /// the per instance vertex data, as in sprite.vert
+    struct Instance {
+        float rect[4];
+        float rotation;
+        uint32_t layer;
+        uint32_t color;
+    };
+
+    void initPipelines(vk::RenderPass renderPass);
+    /// sort keys (high 32 bits) with the sprite index (low 32 bits)
+    void sort();
+
+private:
+    vk::PhysicalDevice physicalDevice;
+    vk::Device device;
+    FrameAllocator& frameMemory;
+    vk::UniqueSampler sampler;
+    vk::UniqueDescriptorSetLayout setLayout;
+    vk::UniquePipelineLayout pipelineLayout;
+    /// indexed by SpriteBlend
+    std::vector<vk::UniquePipeline> pipelines;
+    vk::UniqueDescriptorPool descriptorPool;
+    vk::DescriptorSet descriptorSet;
+    ImageAllocation textures;
+    std::vector<uint32_t> pendingPixels;
+    bool texturesReady;
+    std::vector<Instance> instances;
+    std::vector<uint64_t> keys;
+    std::vector<uint64_t> sortScratch;
+    uint32_t lastDrawCalls;
+};
+
+#endif //_sprite_h
@@ -0,0 +1,198 @@
+/*
+    spritebench.cpp: Sprite batching stress scene
+    Copyright (C) 2019 Malte Kieling
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <SDL.h>
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <iostream>
+#include <string>
+
+#include "application.h"
+#include "sprite.h"
+
+static constexpr uint32_t textureSize = 32;
+static constexpr uint32_t textureCount = 8;
+
+/// a sprite and where it is going
+struct Mover {
+    Sprite sprite;
+    float vx;
+    float vy;
+    float spin;
+};
+
+/**
+ * \brief Bounces lots of sprites around the window and measures the cpu side of the batching
+ * usage: spritebench [--sprites n] [--frames n] [--headless]
+ */
+class SpriteBench : public Application {
+public:
+    SpriteBench(const ApplicationCreateInfo& info, uint32_t spriteCount)
+        : Application(info)
+        , sprites(physicalDevice, logicalDevice.get(), renderPass.get(), frameMemory())
+        , cpuTicks(0)
+        , spritesDrawn(0)
+        , drawCalls(0)
+    {
+        initTextures();
+        initMovers(spriteCount);
+    }
+
+    void run() override
+    {
+        auto start = SDL_GetPerformanceCounter();
+        Application::run();
+        auto end = SDL_GetPerformanceCounter();
+
+        double frequency = static_cast<double>(SDL_GetPerformanceFrequency());
+        double seconds = static_cast<double>(end - start) / frequency;
+        double cpuMs = static_cast<double>(cpuTicks) * 1000.0 / frequency;
+        double drawn = static_cast<double>(spritesDrawn);
+        std::cout << "frames: " << frameCount << " in " << seconds << "s" << std::endl;
+        std::cout << "sprites/frame: " << movers.size() << ", draw calls/frame: " << (frameCount > 0 ? drawCalls / frameCount : 0) << std::endl;
+        std::cout << "sprites/s: " << drawn / seconds << std::endl;
+        std::cout << "cpu ms per 10k sprites: " << (drawn > 0.0 ? cpuMs * 10000.0 / drawn : 0.0) << std::endl;
+        std::cout << "frame memory high water mark: " << frameMemory().highWaterMark() << " bytes, " << frameMemory().spillCount() << " spills" << std::endl;
+    }
+
+protected:
+    void recordFrame(vk::CommandBuffer commandBuffer, const std::vector<WindowData*>& targets) override
+    {
+        // once, but it has to be outside the render pass
+        sprites.upload(commandBuffer);
+        Application::recordFrame(commandBuffer, targets);
+    }
+
+    void recordScene(vk::CommandBuffer commandBuffer, const WindowData& window) override
+    {
+        // everything the batching costs on the cpu: moving, adding, sorting, writing and recording
+        auto start = SDL_GetPerformanceCounter();
+        auto size = window.renderTarget.extent;
+        float w = static_cast<float>(size.width);
+        float h = static_cast<float>(size.height);
+        for (auto& mover : movers) {
+            auto& sprite = mover.sprite;
+            sprite.x += mover.vx;
+            sprite.y += mover.vy;
+            sprite.rotation += mover.spin;
+            if (sprite.x < 0.0f || sprite.x > w) {
+                mover.vx = -mover.vx;
+            }
+            if (sprite.y < 0.0f || sprite.y > h) {
+                mover.vy = -mover.vy;
+            }
+            sprites.add(sprite);
+        }
+        spritesDrawn += sprites.size();
+        sprites.draw(commandBuffer, size);
+        drawCalls += sprites.drawCalls();
+        cpuTicks += SDL_GetPerformanceCounter() - start;
+    }
+
+private:
+    void initTextures()
+    {
+        // soft discs in a few colors
+        std::vector<std::vector<uint32_t>> layers(textureCount);
+        for (uint32_t layer = 0; layer < textureCount; layer++) {
+            uint32_t r = (layer & 1) ? 255 : 128;
+            uint32_t g = (layer & 2) ? 255 : 128;
+            uint32_t b = (layer & 4) ? 255 : 128;
+            layers[layer].resize(textureSize * textureSize);
+            for (uint32_t y = 0; y < textureSize; y++) {
+                for (uint32_t x = 0; x < textureSize; x++) {
+                    float dx = (static_cast<float>(x) + 0.5f) / textureSize * 2.0f - 1.0f;
+                    float dy = (static_cast<float>(y) + 0.5f) / textureSize * 2.0f - 1.0f;
+                    float alpha = std::max(0.0f, 1.0f - std::sqrt(dx * dx + dy * dy));
+                    uint32_t a = static_cast<uint32_t>(alpha * 255.0f);
+                    layers[layer][y * textureSize + x] = r | (g << 8) | (b << 16) | (a << 24);
+                }
+            }
+        }
+        sprites.setTextures(textureSize, textureSize, layers);
+    }
+
+    void initMovers(uint32_t spriteCount)
+    {
+        // deterministic, so runs can be compared
+        uint32_t seed = 1;
+        auto random = [&seed]() {
+            seed = seed * 1664525u + 1013904223u;
+            return static_cast<float>(seed >> 8) / static_cast<float>(1 << 24);
+        };
+
+        movers.resize(spriteCount);
+        for (auto& mover : movers) {
+            auto& sprite = mover.sprite;
+            sprite.x = random() * static_cast<float>(createInfo.w);
+            sprite.y = random() * static_cast<float>(createInfo.h);
+            sprite.w = 4.0f + random() * 12.0f;
+            sprite.h = sprite.w;
+            sprite.texture = static_cast<uint32_t>(random() * textureCount) % textureCount;
+            // a few z levels and blend modes, like a hud would have
+            sprite.z = static_cast<uint8_t>(random() * 4.0f);
+            sprite.blend = random() < 0.25f ? SpriteBlend::Additive : SpriteBlend::Alpha;
+            mover.vx = random() * 4.0f - 2.0f;
+            mover.vy = random() * 4.0f - 2.0f;
+            mover.spin = random() * 0.1f - 0.05f;
+        }
+    }
+
+private:
+    SpriteBatch sprites;
+    std::vector<Mover> movers;
+    uint64_t cpuTicks;
+    uint64_t spritesDrawn;
+    uint64_t drawCalls;
+};
+
+int main(int argc, char** argv)
+{
+    try {
+        ApplicationCreateInfo info;
+        info.title = "Sprite Bench";
+        info.enableValidation = false;
+        // measure the batching, not the display
+        info.defaultPresetMode = vk::PresentModeKHR::eImmediate;
+        info.dynamicResolution = false;
+        info.maxFrames = 1000;
+        uint32_t spriteCount = 100000;
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--headless") {
+                info.headless = true;
+            } else if (arg == "--frames" && hasValue) {
+                info.maxFrames = std::stoull(argv[++i]);
+            } else if (arg == "--sprites" && hasValue) {
+                spriteCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+            }
+        }
+        // instances of all sprites in every frame, the allocator grows if this is short
+        info.frameMemorySize = std::max<vk::DeviceSize>(info.frameMemorySize, static_cast<vk::DeviceSize>(spriteCount) * 32);
+        SpriteBench bench(info, spriteCount);
+        bench.run();
+    } catch (std::exception& err) {
+        std::cerr << "Critical Error: " << err.what() << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
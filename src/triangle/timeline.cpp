@@ -0,0 +1,151 @@
+/*
+    timeline.cpp: GPU timelines on top of timeline semaphores
+    Copyright (C) 2019 Malte Kieling
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "timeline.h"
+
+#include <algorithm>
+
+GpuTimeline::GpuTimeline(const vk::Device& device)
+    : device(device)
+{
+    vk::SemaphoreTypeCreateInfo typeInfo(vk::SemaphoreType::eTimeline, 0);
+    vk::SemaphoreCreateInfo semaphoreInfo;
+    semaphoreInfo.pNext = &typeInfo;
+    timelineSemaphore = device.createSemaphoreUnique(semaphoreInfo);
+}
+
+vk::Semaphore GpuTimeline::semaphore() const
+{
+    return timelineSemaphore.get();
+}
+
+uint64_t GpuTimeline::next()
+{
+    return ++submitted;
+}
+
+uint64_t GpuTimeline::lastSubmitted() const
+{
+    return submitted;
+}
+
+uint64_t GpuTimeline::pending() const
+{
+    return submitted + 1;
+}
+
+uint64_t GpuTimeline::completed() const
+{
+    completedCache = device.getSemaphoreCounterValue(timelineSemaphore.get());
+    return completedCache;
+}
+
+bool GpuTimeline::reached(uint64_t value) const
+{
+    if (value <= completedCache) {
+        return true;
+    }
+
+    return value <= completed();
+}
+
+void GpuTimeline::wait(uint64_t value, uint64_t timeout) const
+{
+    if (reached(value)) {
+        return;
+    }
+
+    auto sem = timelineSemaphore.get();
+    vk::SemaphoreWaitInfo waitInfo(vk::SemaphoreWaitFlags(), 1, &sem, &value);
+    if (device.waitSemaphores(waitInfo, timeout) == vk::Result::eSuccess) {
+        completedCache = std::max(completedCache, value);
+    }
+}
+
+void TimelineSubmit::wait(const TimelineWait& w)
+{
+    waitSemaphores.push_back(w.semaphore);
+    waitValues.push_back(w.value);
+    waitStages.push_back(w.stage);
+}
+
+void TimelineSubmit::wait(vk::Semaphore binarySemaphore, vk::PipelineStageFlags stage)
+{
+    wait({ binarySemaphore, 0, stage });
+}
+
+void TimelineSubmit::signal(const TimelineSignal& s)
+{
+    signalSemaphores.push_back(s.semaphore);
+    signalValues.push_back(s.value);
+}
+
+void TimelineSubmit::signal(vk::Semaphore binarySemaphore)
+{
+    signal({ binarySemaphore, 0 });
+}
+
+vk::SubmitInfo TimelineSubmit::get(const std::vector<vk::CommandBuffer>& commandBuffers)
+{
+    timelineInfo = vk::TimelineSemaphoreSubmitInfo(
+        static_cast<uint32_t>(waitValues.size()),
+        waitValues.data(),
+        static_cast<uint32_t>(signalValues.size()),
+        signalValues.data());
+
+    vk::SubmitInfo submitInfo(
+        static_cast<uint32_t>(waitSemaphores.size()),
+        waitSemaphores.data(),
+        waitStages.data(),
+        static_cast<uint32_t>(commandBuffers.size()),
+        commandBuffers.data(),
+        static_cast<uint32_t>(signalSemaphores.size()),
+        signalSemaphores.data());
+    submitInfo.pNext = &timelineInfo;
+    return submitInfo;
+}
+
+void RetireQueue::retireCallback(const GpuTimeline& timeline, uint64_t value, std::function<void()> release)
+{
+    entries.push_back({ &timeline, value, std::move(release) });
+}
+
+void RetireQueue::collect()
+{
+    // release in order, things retired later might depend on earlier ones
+    auto firstLeft = std::stable_partition(entries.begin(), entries.end(), [](const Entry& entry) {
+        return entry.timeline->reached(entry.value);
+    });
+    for (auto iter = entries.begin(); iter != firstLeft; iter++) {
+        iter->release();
+    }
+    entries.erase(entries.begin(), firstLeft);
+}
+
+void RetireQueue::clear()
+{
+    for (auto& entry : entries) {
+        entry.release();
+    }
+    entries.clear();
+}
+
+size_t RetireQueue::size() const
+{
+    return entries.size();
+}
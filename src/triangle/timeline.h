@@ -0,0 +1,140 @@
+/*
+    timeline.h: GPU timelines on top of timeline semaphores
+    Copyright (C) 2019 Malte Kieling
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _timeline_h
+#define _timeline_h
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/**
+ * \brief A timeline semaphore owned by a single queue
+ * Every submit to the queue signals the next value, so values only ever grow.
+ * Anything used by a submit is done once completed() reached its value.
+ */
+class GpuTimeline {
+public:
+    GpuTimeline() = default;
+    explicit GpuTimeline(const vk::Device& device);
+
+    /// the semaphore to wait on/signal in submits
+    vk::Semaphore semaphore() const;
+
+    /// reserve the value the next submit will signal
+    uint64_t next();
+
+    /// the value of the latest submit (not necessarily done yet)
+    uint64_t lastSubmitted() const;
+
+    /// the value the next submit will signal. For things used by commands that are still being recorded
+    uint64_t pending() const;
+
+    /// the value the gpu reached. Does not block
+    uint64_t completed() const;
+
+    /// true if value is done. Does not block, and only asks the driver if the cached value is too old
+    bool reached(uint64_t value) const;
+
+    /// block until value is reached
+    void wait(uint64_t value, uint64_t timeout = std::numeric_limits<uint64_t>::max()) const;
+
+private:
+    vk::Device device;
+    vk::UniqueSemaphore timelineSemaphore;
+    uint64_t submitted = 0;
+    mutable uint64_t completedCache = 0;
+};
+
+/// a wait on a timeline value before a submit starts the given stages
+struct TimelineWait {
+    vk::Semaphore semaphore;
+    uint64_t value;
+    vk::PipelineStageFlags stage;
+};
+
+/// a signal of a timeline value once a submit is done
+struct TimelineSignal {
+    vk::Semaphore semaphore;
+    uint64_t value;
+};
+
+/**
+ * \brief Collects waits and signals of a single vk::SubmitInfo
+ * Binary semaphores (swapchain acquire/present) go in with a value of 0, which is ignored.
+ * Keeps the arrays alive for as long as the submit info is used.
+ */
+struct TimelineSubmit {
+    void wait(const TimelineWait& w);
+    void wait(vk::Semaphore binarySemaphore, vk::PipelineStageFlags stage);
+    void signal(const TimelineSignal& s);
+    void signal(vk::Semaphore binarySemaphore);
+
+    /// build the submit info. The result points into this object
+    vk::SubmitInfo get(const std::vector<vk::CommandBuffer>& commandBuffers);
+
+    std::vector<vk::Semaphore> waitSemaphores;
+    std::vector<uint64_t> waitValues;
+    std::vector<vk::PipelineStageFlags> waitStages;
+    std::vector<vk::Semaphore> signalSemaphores;
+    std::vector<uint64_t> signalValues;
+    vk::TimelineSemaphoreSubmitInfo timelineInfo;
+};
+
+/**
+ * \brief Keeps resources alive until a timeline passed a value
+ * collect() frees everything that is done and never blocks.
+ * Whatever is left on destruction is freed right away, so the gpu must be idle by then.
+ */
+class RetireQueue {
+public:
+    /// call release once timeline reached value
+    void retireCallback(const GpuTimeline& timeline, uint64_t value, std::function<void()> release);
+
+    /// own object (unique handles, vectors of them, allocations...) until timeline reached value. Callables are owned, not called
+    template <typename T>
+    void retire(const GpuTimeline& timeline, uint64_t value, T&& object)
+    {
+        auto owned = std::make_shared<std::decay_t<T>>(std::forward<T>(object));
+        retireCallback(timeline, value, [owned]() mutable { owned.reset(); });
+    }
+
+    /// free everything that is done
+    void collect();
+
+    /// free everything right away. Only when the gpu is idle
+    void clear();
+
+    /// number of resources still waiting
+    size_t size() const;
+
+private:
+    struct Entry {
+        const GpuTimeline* timeline;
+        uint64_t value;
+        std::function<void()> release;
+    };
+    std::vector<Entry> entries;
+};
+
+#endif //_timeline_h
@@ -19,6 +19,7 @@
 #include <SDL.h>
 
 #include <exception>
+#include <string>
 
 #include "application.h"
 
@@ -27,7 +28,33 @@ int main(int argc, char** argv)
     try {
         ApplicationCreateInfo info;
         info.title = "Hello Triangle";
+        // --headless, --frames <n>, --capture <file prefix>, --capture-pipe <command>, --windows <n>, --dynamic-resolution
+        int windowCount = 1;
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--headless") {
+                info.headless = true;
+            } else if (arg == "--frames" && hasValue) {
+                info.maxFrames = std::stoull(argv[++i]);
+            } else if (arg == "--capture" && hasValue) {
+                info.capture.enabled = true;
+                info.capture.output = CaptureOutput::PpmFiles;
+                info.capture.target = argv[++i];
+            } else if (arg == "--capture-pipe" && hasValue) {
+                info.capture.enabled = true;
+                info.capture.output = CaptureOutput::Pipe;
+                info.capture.target = argv[++i];
+            } else if (arg == "--windows" && hasValue) {
+                windowCount = std::stoi(argv[++i]);
+            } else if (arg == "--dynamic-resolution") {
+                info.dynamicResolution = true;
+            }
+        }
         Application app(info);
+        for (int i = 1; i < windowCount && !info.headless; i++) {
+            app.openWindow(info.title + " " + std::to_string(i + 1), SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, info.w / 2, info.h / 2);
+        }
         app.run();
     } catch (std::exception err) {
         SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Critical Error", err.what(), nullptr);
@@ -18,26 +18,41 @@
 
 #include "util.h"
 
-QueueFamilyData::QueueFamilyData(const vk::PhysicalDevice& device, vk::UniqueSurfaceKHR& windowSurface)
+#include <fstream>
+#include <stdexcept>
+
+QueueFamilyData::QueueFamilyData(const vk::PhysicalDevice& device, const vk::UniqueSurfaceKHR& windowSurface)
+    : needsPresent(static_cast<bool>(windowSurface))
 {
     auto properties = device.getQueueFamilyProperties();
-    int i = 0;
-    for (const auto& family : properties) {
-        if (family.queueCount > 0 && family.queueFlags & vk::QueueFlagBits::eGraphics) {
+    // no early out here, a dedicated compute family might come after the graphics one
+    for (uint32_t i = 0; i < static_cast<uint32_t>(properties.size()); i++) {
+        const auto& family = properties[i];
+        if (family.queueCount == 0) {
+            continue;
+        }
+
+        bool graphics = static_cast<bool>(family.queueFlags & vk::QueueFlagBits::eGraphics);
+        bool compute = static_cast<bool>(family.queueFlags & vk::QueueFlagBits::eCompute);
+        if (graphics && !graphicsFamily) {
             graphicsFamily = i;
         }
 
-        bool presentSupport = device.getSurfaceSupportKHR(i, windowSurface.get());
-        if (family.queueCount > 0 && presentSupport) {
-            presentFamily = i;
+        if (compute && !graphics && !computeFamily) {
+            computeFamily = i;
         }
 
-        // are we complete
-        if (*this) {
-            break;
+        // prefer presenting from the graphics family
+        if (needsPresent && device.getSurfaceSupportKHR(i, windowSurface.get())) {
+            if (!presentFamily || (graphics && graphicsFamily == i)) {
+                presentFamily = i;
+            }
         }
+    }
 
-        i++;
+    // no async compute, the graphics family is required to do compute as well
+    if (!computeFamily && graphicsFamily) {
+        computeFamily = graphicsFamily;
     }
 }
 
@@ -49,7 +64,10 @@ std::vector<uint32_t> QueueFamilyData::get() const
     }
 
     result.push_back(graphicsFamily.value());
-    result.push_back(presentFamily.value());
+    if (presentFamily) {
+        result.push_back(presentFamily.value());
+    }
+    result.push_back(computeFamily.value());
 
     return result;
 }
@@ -87,5 +105,133 @@ std::vector<vk::DeviceQueueCreateInfo> QueueFamilyData::getCreateInfos() const
 QueueFamilyData::operator bool() const
 {
     return graphicsFamily.has_value()
-        && presentFamily.has_value();
+        && (presentFamily.has_value() || !needsPresent)
+        && computeFamily.has_value();
+}
+
+uint32_t findMemoryType(const vk::PhysicalDevice& physicalDevice, uint32_t typeBits, vk::MemoryPropertyFlags properties)
+{
+    auto memoryProperties = physicalDevice.getMemoryProperties();
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        if ((typeBits & (1u << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("No suitable memory type");
+}
+
+BufferAllocation createBuffer(
+    const vk::PhysicalDevice& physicalDevice,
+    const vk::Device& device,
+    vk::DeviceSize size,
+    vk::BufferUsageFlags usage,
+    vk::MemoryPropertyFlags properties,
+    const std::vector<uint32_t>& queueFamilies)
+{
+    BufferAllocation result;
+    result.size = size;
+
+    vk::BufferCreateInfo bufferInfo(
+        vk::BufferCreateFlags(),
+        size,
+        usage,
+        queueFamilies.size() > 1 ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive,
+        queueFamilies.size() > 1 ? static_cast<uint32_t>(queueFamilies.size()) : 0,
+        queueFamilies.size() > 1 ? queueFamilies.data() : nullptr);
+    result.buffer = device.createBufferUnique(bufferInfo);
+
+    auto requirements = device.getBufferMemoryRequirements(result.buffer.get());
+    vk::MemoryAllocateInfo allocInfo(
+        requirements.size,
+        findMemoryType(physicalDevice, requirements.memoryTypeBits, properties));
+    result.memory = device.allocateMemoryUnique(allocInfo);
+    device.bindBufferMemory(result.buffer.get(), result.memory.get(), 0);
+
+    if (properties & vk::MemoryPropertyFlagBits::eHostVisible) {
+        result.mapped = device.mapMemory(result.memory.get(), 0, VK_WHOLE_SIZE);
+    }
+
+    return result;
+}
+
+ImageAllocation createImage(
+    const vk::PhysicalDevice& physicalDevice,
+    const vk::Device& device,
+    vk::Extent2D extent,
+    vk::Format format,
+    vk::ImageUsageFlags usage,
+    uint32_t layers)
+{
+    ImageAllocation result;
+    result.format = format;
+    result.extent = extent;
+
+    vk::ImageCreateInfo imageInfo(
+        vk::ImageCreateFlags(),
+        vk::ImageType::e2D,
+        format,
+        vk::Extent3D(extent.width, extent.height, 1),
+        1,
+        layers,
+        vk::SampleCountFlagBits::e1,
+        vk::ImageTiling::eOptimal,
+        usage,
+        vk::SharingMode::eExclusive,
+        0,
+        nullptr,
+        vk::ImageLayout::eUndefined);
+    result.image = device.createImageUnique(imageInfo);
+
+    auto requirements = device.getImageMemoryRequirements(result.image.get());
+    vk::MemoryAllocateInfo allocInfo(
+        requirements.size,
+        findMemoryType(physicalDevice, requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal));
+    result.memory = device.allocateMemoryUnique(allocInfo);
+    device.bindImageMemory(result.image.get(), result.memory.get(), 0);
+
+    vk::ComponentMapping mapping(
+        vk::ComponentSwizzle::eR,
+        vk::ComponentSwizzle::eG,
+        vk::ComponentSwizzle::eB,
+        vk::ComponentSwizzle::eA);
+    vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, 1, 0, layers);
+    vk::ImageViewCreateInfo viewInfo(
+        vk::ImageViewCreateFlags(),
+        result.image.get(),
+        layers > 1 ? vk::ImageViewType::e2DArray : vk::ImageViewType::e2D,
+        format,
+        mapping,
+        range);
+    result.view = device.createImageViewUnique(viewInfo);
+
+    return result;
+}
+
+std::vector<uint32_t> readSpirv(const std::string& filename)
+{
+    std::string path = filename;
+    bool relative = !path.empty() && path[0] != '/' && path.find(':') == std::string::npos;
+    if (relative) {
+        char* basePath = SDL_GetBasePath();
+        if (basePath) {
+            path = std::string(basePath) + path;
+            SDL_free(basePath);
+        }
+    }
+
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot open shader " + path);
+    }
+
+    size_t size = static_cast<size_t>(file.tellg());
+    if (size == 0 || size % sizeof(uint32_t) != 0) {
+        throw std::runtime_error("Invalid SPIR-V in " + path);
+    }
+
+    std::vector<uint32_t> code(size / sizeof(uint32_t));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(code.data()), size);
+    return code;
 }
\ No newline at end of file
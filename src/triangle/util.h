@@ -23,11 +23,14 @@
 #include <vulkan/vulkan.hpp>
 
 #include <optional>
+#include <string>
 #include <vector>
 
 // somewhat stolen from vulkan-tutorial.com
+// an empty windowSurface means headless, so no present family is needed.
+// computeFamily prefers a family without graphics (async compute) and falls back to the graphics one
 struct QueueFamilyData {
-    QueueFamilyData(const vk::PhysicalDevice& device, vk::UniqueSurfaceKHR& windowSurface);
+    QueueFamilyData(const vk::PhysicalDevice& device, const vk::UniqueSurfaceKHR& windowSurface);
 
     std::vector<uint32_t> get() const;
 
@@ -37,10 +40,58 @@ struct QueueFamilyData {
 
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    std::optional<uint32_t> computeFamily;
+    bool needsPresent;
 
     operator bool() const;
 };
 
+/// A buffer together with the memory backing it
+struct BufferAllocation {
+    vk::UniqueDeviceMemory memory;
+    vk::UniqueBuffer buffer;
+    vk::DeviceSize size = 0;
+    /// only set for host visible allocations, mapped for the whole lifetime
+    void* mapped = nullptr;
+};
+
+/// An image together with its memory and a view of all of it
+struct ImageAllocation {
+    vk::UniqueDeviceMemory memory;
+    vk::UniqueImage image;
+    vk::UniqueImageView view;
+    vk::Format format = vk::Format::eUndefined;
+    vk::Extent2D extent;
+};
+
+/// find a memory type that fits typeBits and has all of properties. throws if there is none
+uint32_t findMemoryType(const vk::PhysicalDevice& physicalDevice, uint32_t typeBits, vk::MemoryPropertyFlags properties);
+
+/**
+ * \brief Create a buffer and bind fresh memory to it
+ * Host visible memory is persistently mapped.
+ * Pass more than one queue family to get a concurrently shared buffer
+ */
+BufferAllocation createBuffer(
+    const vk::PhysicalDevice& physicalDevice,
+    const vk::Device& device,
+    vk::DeviceSize size,
+    vk::BufferUsageFlags usage,
+    vk::MemoryPropertyFlags properties,
+    const std::vector<uint32_t>& queueFamilies = {});
+
+/// Create a device local 2D color image (with layers > 1 an array) and a view of it
+ImageAllocation createImage(
+    const vk::PhysicalDevice& physicalDevice,
+    const vk::Device& device,
+    vk::Extent2D extent,
+    vk::Format format,
+    vk::ImageUsageFlags usage,
+    uint32_t layers = 1);
+
+/// read a SPIR-V file. Relative paths are resolved against the executable directory
+std::vector<uint32_t> readSpirv(const std::string& filename);
+
 
 
 #endif //_util_h
\ No newline at end of file